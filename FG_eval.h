@@ -0,0 +1,185 @@
+#ifndef FG_EVAL_H
+#define FG_EVAL_H
+
+#include <vector>
+#include <cppad/cppad.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "cost_weights.h"
+#include "integrator.h"
+#include "vehicle_model.h"
+
+using CppAD::AD;
+using namespace std;
+
+// The solver takes all the state variables and actuator
+// variables in a singular vector. Thus, we should to establish
+// when one variable starts and another ends to make our lifes easier.
+// The horizon holds `n` states: the N planned states plus the states spent
+// on the actuator delay, if any. Each state is stored as n consecutive
+// values. The actuators are held constant over blocks of intervals
+// (move blocking), so each actuator is stored as n_blocks consecutive
+// values and block[t] is the block of the interval between state t and t+1.
+template <class Model>
+struct Layout {
+  size_t n;
+  vector<size_t> block;
+  size_t n_blocks;
+  // One block per interval.
+  Layout(size_t n) : n(n), block(n - 1), n_blocks(n - 1)
+  {
+    for (size_t t=0; t<n-1; t++) { block[t] = t; }
+  }
+  Layout(size_t n, const vector<size_t> &block)
+    : n(n), block(block), n_blocks(block.back() + 1) {}
+  size_t state_start(size_t i) const { return i * n; }
+  size_t input_start(size_t j) const { return Model::n_states * n + j * n_blocks; }
+  // Index of actuator j applied during interval t.
+  size_t input(size_t j, size_t t) const { return input_start(j) + block[t]; }
+  size_t n_vars() const { return Model::n_states * n + Model::n_inputs * n_blocks; }
+  size_t n_constraints() const { return Model::n_states * n; }
+};
+
+template <class Model>
+class FG_eval {
+public:
+  // Fitted polynomial coefficients
+  Eigen::VectorXd coeffs;
+  // Variable layout of the horizon
+  Layout<Model> layout;
+  // Length of each interval of the horizon, dts[t] is the time between
+  // state t and state t+1.
+  vector<double> dts;
+  // Model parameters of each stage, Model::n_params values per state.
+  vector<double> params;
+  // Integration scheme of the dynamics constraints
+  Integrator integrator;
+  size_t substeps;
+  // Weights of the cost terms and reference speed
+  CostWeights w;
+  // Quadratic cost on the deviation of the last state from the reference,
+  // none if empty.
+  Eigen::MatrixXd terminal;
+  // Constructor
+  FG_eval(Eigen::VectorXd coeffs, const Layout<Model> &layout, const vector<double> &dts,
+          const vector<double> &params, Integrator integrator, size_t substeps,
+          const CostWeights &w)
+    : coeffs(coeffs), layout(layout), dts(dts), params(params),
+      integrator(integrator), substeps(substeps), w(w) {}
+  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
+  // `fg` is a vector containing the cost and constraints.
+  // `vars` is a vector containing the variable values (state & actuators).
+  void operator()(ADvector& fg, const ADvector& vars)
+  {
+    // NOTE: You'll probably go back and forth between this function and
+    // the Solver function below.
+    // The cost is stored in the first element of 'fg'.
+    // Any additions to the cost should be added to 'fg[0]'
+    const size_t N = layout.n;
+    const size_t v_start = layout.state_start(Model::V);
+    const size_t cte_start = layout.state_start(Model::CTE);
+    const size_t epsi_start = layout.state_start(Model::EPSI);
+    fg[0] = 0.0;
+    // The part of the cost based on the reference state.
+    for (size_t t=0; t<N; t++)
+    {
+      fg[0] += w.cte * CppAD::pow(vars[cte_start + t], 2);
+      fg[0] += w.epsi * CppAD::pow(vars[epsi_start + t], 2);
+      fg[0] += w.v * CppAD::pow(vars[v_start + t] - w.ref_v, 2);
+    }
+    // Minimize the use of actuators.
+    // A block is weighted by the number of intervals it spans.
+    for (size_t t=0; t<N-1; t++)
+    {
+      fg[0] += w.delta * CppAD::pow(vars[layout.input(Model::DELTA, t)], 2);
+      fg[0] += w.a * CppAD::pow(vars[layout.input(Model::A, t)], 2);
+      //fg[0] += 1 * CppAD::pow(vars[delta_start + t] * vars[v_start+t], 2);
+    }
+    // Minimize the value gap between sequential actuations.
+    // Inside a block the gap is zero, so only block boundaries count.
+    for (size_t t=0; t<N-2; t++)
+    {
+      if (layout.block[t + 1] == layout.block[t]) { continue; }
+      const size_t delta0 = layout.input(Model::DELTA, t);
+      const size_t delta1 = layout.input(Model::DELTA, t + 1);
+      const size_t a0 = layout.input(Model::A, t);
+      const size_t a1 = layout.input(Model::A, t + 1);
+      fg[0] += w.ddelta * CppAD::pow(vars[delta1] - vars[delta0], 2);
+      fg[0] += w.da * CppAD::pow(vars[a1] - vars[a0], 2);
+    }
+    // Minimize the value gap between sequential errors
+    for (size_t t=0; t<N-1; t++)
+    {
+      fg[0] += w.dcte * CppAD::pow(vars[cte_start + t + 1] - vars[cte_start + t], 2);
+      fg[0] += w.depsi * CppAD::pow(vars[epsi_start + t + 1] - vars[epsi_start + t], 2);
+    }
+    // Add the affection of curvature
+    for (size_t t=0; t<N-1; t++)
+    {
+      AD<double> s[Model::n_states];
+      state(vars, t, s);
+      fg[0] += w.curvature * Model::curvature(s, stage(t), coeffs) * vars[v_start+t];
+    }
+
+    // Terminal cost on the deviation of the last state from the reference.
+    if (terminal.size() > 0)
+    {
+      AD<double> d[Model::n_states];
+      state(vars, N - 1, d);
+      d[Model::V] -= w.ref_v;
+      for (size_t i=0; i<Model::n_states; i++)
+      {
+        for (size_t k=0; k<Model::n_states; k++)
+        {
+          if (terminal(i, k) != 0) { fg[0] += terminal(i, k) * d[i] * d[k]; }
+        }
+      }
+    }
+
+    // Setup constraints
+    // Initial contraints
+    // We add 1 to each of the starting indices due to cost being located at index 0 of 'fg'.
+    for (size_t i=0; i<Model::n_states; i++)
+    {
+      fg[1 + layout.state_start(i)] = vars[layout.state_start(i)];
+    }
+    // The rest of constraints
+    for (size_t t=1; t<N; t++)
+    {
+      // The state at time t.
+      AD<double> s0[Model::n_states];
+      state(vars, t - 1, s0);
+      // Only consider the actuation at time t.
+      AD<double> u0[Model::n_inputs];
+      for (size_t j=0; j<Model::n_inputs; j++)
+      {
+        u0[j] = vars[layout.input(j, t - 1)];
+      }
+      // Predict the state at time t+1 with the selected integrator and
+      // constrain the state variables to it.
+      AD<double> pred[Model::n_states];
+      Model::step(s0, u0, stage(t - 1), coeffs, dts[t - 1], integrator, substeps, pred);
+      for (size_t i=0; i<Model::n_states; i++)
+      {
+        fg[1 + layout.state_start(i) + t] = vars[layout.state_start(i) + t] - pred[i];
+      }
+    }
+  }
+
+private:
+  // Parameters of the stage at time t.
+  const double *stage(size_t t) const
+  {
+    return params.data() + t * Model::n_params;
+  }
+
+  // Gather the state at time t.
+  void state(const ADvector& vars, size_t t, AD<double> *s) const
+  {
+    for (size_t i=0; i<Model::n_states; i++)
+    {
+      s[i] = vars[layout.state_start(i) + t];
+    }
+  }
+};
+
+#endif /* FG_EVAL_H */
@@ -1,209 +1,319 @@
 #include "MPC.h"
+#include <algorithm>
 #include <cppad/cppad.hpp>
 #include <cppad/ipopt/solve.hpp>
 #include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+#include "ipopt_stats.h"
+#include "logger.h"
+#include "lqr.h"
 
-using CppAD::AD;
+// Width of the speed bands the terminal cost is precomputed for, and the
+// number of bands.
+const double terminal_band_width = 5.0; // m/s
+const size_t n_terminal_bands = 15;
 
-// Set the timestep length and duration
-size_t N = 10;
-double dt = 0.1;
-// This value assumes the model presented in the classroom is used.
-// Lf was obtained by measuring the radius formed by running the vehicle in the
-// simulator around in a circle with a constant steering angle and velocity on a
-// flat terrain.
-// Lf was tuned until the the radius formed by the simulating the model
-// presented in the classroom matched the previous radius.
-// This is the length from front to CoG that has a similar radius.
-const double Lf = 2.67;
-// Set reference speed
-// Note the unit is m/s, not mph
-double ref_v = 50; // m/s
-// The solver takes all the state variables and actuator
-// variables in a singular vector. Thus, we should to establish
-// when one variable starts and another ends to make our lifes easier.
-size_t x_start = 0;
-size_t y_start = x_start + N;
-size_t psi_start = y_start + N;
-size_t v_start = psi_start + N;
-size_t cte_start = v_start + N;
-size_t epsi_start = cte_start + N;
-size_t delta_start = epsi_start + N;
-size_t a_start = delta_start + N - 1;
-
-class FG_eval {
-public:
-  // Fitted polynomial coefficients
-  Eigen::VectorXd coeffs;
-  // Constructor
-  FG_eval(Eigen::VectorXd coeffs) { this->coeffs = coeffs; }
-  typedef CPPAD_TESTVECTOR(AD<double>) ADvector;
-  // `fg` is a vector containing the cost and constraints.
-  // `vars` is a vector containing the variable values (state & actuators).
-  void operator()(ADvector& fg, const ADvector& vars)
+// Map each interval of the horizon to its actuator block. The delay
+// intervals keep one block each since their actuators are fixed. The
+// planned intervals are grouped by `move_blocks`, the last block being
+// stretched or cut to end with the horizon. No blocks means one block per
+// interval.
+static vector<size_t> ActuatorBlocks(size_t n_delay, size_t n_intervals,
+                                     const vector<size_t> &move_blocks)
+{
+  vector<size_t> block(n_intervals);
+  size_t b = 0;
+  size_t left = 0;
+  size_t k = 0;
+  for (size_t t=0; t<n_intervals; t++)
   {
-    // NOTE: You'll probably go back and forth between this function and
-    // the Solver function below.
-    // The cost is stored in the first element of 'fg'.
-    // Any additions to the cost should be added to 'fg[0]'
-    fg[0] = 0.0;
-    // The part of the cost based on the reference state.
-    for (size_t t=0; t<N; t++)
-    {
-      fg[0] += 10 * CppAD::pow(vars[cte_start + t], 2);
-      fg[0] += 2 * CppAD::pow(vars[epsi_start + t], 2);
-      fg[0] += CppAD::pow(vars[v_start + t] - ref_v, 2);
-    }
-    // Minimize the use of actuators.
-    for (size_t t=0; t<N-1; t++)
-    {
-      fg[0] +=  1000  * CppAD::pow(vars[delta_start + t], 2);
-      fg[0] += CppAD::pow(vars[a_start + t], 2);
-      //fg[0] += 1 * CppAD::pow(vars[delta_start + t] * vars[v_start+t], 2);
-    }
-    // Minimize the value gap between sequential actuations.
-    for (size_t t=0; t<N-2; t++)
-    {
-      fg[0] += 200 * CppAD::pow(vars[delta_start + t + 1] - vars[delta_start + t], 2);
-      fg[0] += CppAD::pow(vars[a_start + t + 1] - vars[a_start + t], 2);
-    }
-    // Minimize the value gap between sequential errors
-    for (size_t t=0; t<N-1; t++)
+    if (t < n_delay || move_blocks.empty())
     {
-      fg[0] += 100*CppAD::pow(vars[cte_start + t + 1] - vars[cte_start + t], 2);
-      fg[0] += 200*CppAD::pow(vars[epsi_start + t + 1] - vars[epsi_start + t], 2);
+      block[t] = t;
+      b = t + 1;
+      continue;
     }
-    // Calculate the curvature at some point
-    /*AD<double> numerator3 = CppAD::abs(2*coeffs[2]+6*coeffs[3]*vars[x_start+3]);
-    AD<double> denominator3 = CppAD::pow(1 + CppAD::pow(coeffs[1]+2*coeffs[2]*vars[x_start+3]+3*coeffs[3]*vars[x_start+3]*vars[x_start+3], 2), 3/2);
-    
-    AD<double> numerator0 = CppAD::abs(2*coeffs[2]+6*coeffs[3]*vars[x_start]);
-    AD<double> denominator0 = CppAD::pow(1 + CppAD::pow(coeffs[1]+2*coeffs[2]*vars[x_start]+3*coeffs[3]*vars[x_start]*vars[x_start], 2), 3/2);
-    
-    AD<double> numerator6 = CppAD::abs(2*coeffs[2]+6*coeffs[3]*vars[x_start+6]);
-    AD<double> denominator6 = CppAD::pow(1 + CppAD::pow(coeffs[1]+2*coeffs[2]*vars[x_start+6]+3*coeffs[3]*vars[x_start+6]*vars[x_start+6], 2), 3/2);
-    */
-     
-    // Add the affection of curvature
-    for (size_t t=0; t<N-1; t++)
+    if (left == 0 && k < move_blocks.size())
     {
-      AD<double> numerator = CppAD::abs(2*coeffs[2]+6*coeffs[3]*vars[x_start+t]);
-      AD<double> denominator = CppAD::pow(1 + CppAD::pow(coeffs[1]+2*coeffs[2]*vars[x_start+t]+3*coeffs[3]*vars[x_start+t]*vars[x_start+t], 2), 3/2);
-      fg[0] += 1150 * numerator/denominator * vars[v_start+t];
+      // Start the next block.
+      left = max<size_t>(move_blocks[k++], 1);
+      block[t] = b++;
     }
-    
-    //std::cout << "Curvature at 0: " << numerator0 / denominator0 << std::endl;
-    //std::cout << "Curvature at 3: " << numerator3 / denominator3 << std::endl;
-    //std::cout << "Curvature at 6: " << numerator6 / denominator6 << std::endl;
-    //std::cout << std::endl;
-    
-    // Setup constraints
-    // Initial contraints
-    // We add 1 to each of the starting indices due to cost being located at index 0 of 'fg'.
-    fg[1 + x_start] = vars[x_start];
-    fg[1 + y_start] = vars[y_start];
-    fg[1 + psi_start] = vars[psi_start];
-    fg[1 + v_start] = vars[v_start];
-    fg[1 + cte_start] = vars[cte_start];
-    fg[1 + epsi_start] = vars[epsi_start];
-    // The rest of constraints
-    for (size_t t=1; t<N; t++)
+    else
     {
-      // The state at time t+1 .
-      AD<double> x1 = vars[x_start + t];
-      AD<double> y1 = vars[y_start + t];
-      AD<double> psi1 = vars[psi_start + t];
-      AD<double> v1 = vars[v_start + t];
-      AD<double> cte1 = vars[cte_start + t];
-      AD<double> epsi1 = vars[epsi_start + t];
-      // The state at time t.
-      AD<double> x0 = vars[x_start + t - 1];
-      AD<double> y0 = vars[y_start + t - 1];
-      AD<double> psi0 = vars[psi_start + t - 1];
-      AD<double> v0 = vars[v_start + t - 1];
-      AD<double> cte0 = vars[cte_start + t - 1];
-      AD<double> epsi0 = vars[epsi_start + t - 1];
-      // Only consider the actuation at time t.
-      AD<double> delta0 = vars[delta_start + t - 1];
-      AD<double> a0 = vars[a_start + t - 1];
-      // Calculate f0 and psides0
-      AD<double> f0 = coeffs[0] + coeffs[1] * x0 + coeffs[2] * CppAD::pow(x0, 2) + coeffs[3] * CppAD::pow(x0, 3);
-      AD<double> psides0 = CppAD::atan(coeffs[1] + 2 * coeffs[2] * x0 + 3 * coeffs[3] * CppAD::pow(x0, 2));
-      // Recall the equations for the model:
-      // x[t+1]    = x[t] + v[t] * cos(psi[t]) * dt
-      // y[t+1]    = y[t] + v[t] * sin(psi[t]) * dt
-      // psi[t+1]  = psi[t] + v[t] / Lf * delta[t] * dt
-      // v[t+1]    = v[t] + a[t] * dt
-      // cte[t+1]  = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
-      // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-      fg[1 + x_start + t]    = x1 - (x0 + v0 * CppAD::cos(psi0) * dt);
-      fg[1 + y_start + t]    = y1 - (y0 + v0 * CppAD::sin(psi0) * dt);
-      fg[1 + psi_start + t]  = psi1 - (psi0 - v0 * delta0 / Lf * dt);
-      fg[1 + v_start + t]    = v1 - (v0 + a0 * dt);
-      fg[1 + cte_start + t]  = cte1 - ((f0 - y0) + (v0 * CppAD::sin(epsi0) * dt));
-      fg[1 + epsi_start + t] = epsi1 - ((psi0 - psides0) - v0 * delta0 / Lf * dt);
+      // Stay in the current block, the last one holds until the end.
+      block[t] = b - 1;
     }
+    if (left > 0) { left--; }
   }
-};
+  return block;
+}
+
+// Value of a piecewise constant plan at `time`, `starts` holding the start
+// time of each interval of the plan.
+static double PlanValueAt(const vector<double> &starts, const vector<double> &values,
+                          double time)
+{
+  size_t k = upper_bound(starts.begin(), starts.end(), time) - starts.begin();
+  return values[(k == 0) ? 0 : k - 1];
+}
 
 //
 // MPC class definition implementation.
 //
-MPC::MPC() {}
+MPC::MPC()
+{
+  // Set the timestep length and duration
+  N = 10;
+  dt = 0.1;
+  // The kinematic bicycle model presented in the classroom
+  model = KINEMATIC_MODEL;
+  // Explicit Euler as in the classroom model
+  integrator = EULER;
+  substeps = 1;
+  // The latency is capped at 0.25 s, so two delay steps keep each of them
+  // no longer than the regular dt for the latencies we actually see.
+  delay_steps = 2;
+  // One actuator value per interval
+  move_blocks.clear();
+  // Start from the previous plan
+  warm_start = true;
+  warm_model = model;
+  // No terminal cost, as in the classroom model
+  terminal_cost = false;
+  verbose = true;
+  last_ok = false;
+}
 
 MPC::~MPC() {}
 
+Eigen::VectorXd MPC::InitialState(double v, double cte, double epsi, double delta) const {
+  Eigen::VectorXd state;
+  switch (model)
+  {
+    case FRENET_MODEL:
+      state.resize(FrenetModel::n_states);
+      FrenetModel::initial_state(v, cte, epsi, delta, state.data());
+      break;
+    case DYNAMIC_BICYCLE_MODEL:
+      state.resize(DynamicBicycleModel::n_states);
+      DynamicBicycleModel::initial_state(v, cte, epsi, delta, state.data());
+      break;
+    case KINEMATIC_MODEL:
+    default:
+      state.resize(KinematicModel::n_states);
+      KinematicModel::initial_state(v, cte, epsi, delta, state.data());
+      break;
+  }
+  return state;
+}
+
+void MPC::CopyWarmStart(const MPC &other) {
+  warm_model = other.warm_model;
+  warm_inputs = other.warm_inputs;
+  warm_starts = other.warm_starts;
+}
+
+void MPC::HoldWarmStart(double seconds) {
+  for (size_t i=0; i<warm_starts.size(); i++) { warm_starts[i] += seconds; }
+}
+
 vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
+  // Without a delay model, assume one planned interval passed since the
+  // previous call.
+  double shift = time_grid.empty() ? dt : time_grid[0];
+  return SolveModel(state, coeffs, 0, 0, 0, 0, shift);
+}
+
+vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs,
+                          double latency, double delta_prev, double a_prev) {
+  // Split the delay into equal sub-steps so that the problem structure only
+  // depends on delay_steps and not on the measured latency.
+  double delay_dt = (delay_steps > 0) ? latency / delay_steps : 0;
+  // The latency is measured as the time between two telemetry messages, so
+  // it is also the time the previous plan moved on since the last call.
+  return SolveModel(state, coeffs, delay_steps, delay_dt, delta_prev, a_prev,
+                    latency);
+}
+
+vector<double> MPC::SolveModel(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                               size_t n_delay, double delay_dt,
+                               double delta_prev, double a_prev, double warm_shift) {
+  switch (model)
+  {
+    case FRENET_MODEL:
+      return SolveHorizon<FrenetModel>(state, coeffs, n_delay, delay_dt,
+                                       delta_prev, a_prev, warm_shift);
+    case DYNAMIC_BICYCLE_MODEL:
+      return SolveHorizon<DynamicBicycleModel>(state, coeffs, n_delay, delay_dt,
+                                               delta_prev, a_prev, warm_shift);
+    case KINEMATIC_MODEL:
+    default:
+      return SolveHorizon<KinematicModel>(state, coeffs, n_delay, delay_dt,
+                                          delta_prev, a_prev, warm_shift);
+  }
+}
+
+template <class Model>
+Eigen::MatrixXd MPC::TerminalCost(double v, double dt_last) {
+  // The bands depend on the model and on how its last interval is
+  // integrated, recompute them when any of these changed.
+  // The stage weights of FG_eval on the reference state and the actuators.
+  Eigen::VectorXd q = Eigen::VectorXd::Zero(Model::n_states);
+  Eigen::VectorXd r = Eigen::VectorXd::Zero(Model::n_inputs);
+  q[Model::CTE] = weights.cte;
+  q[Model::EPSI] = weights.epsi;
+  q[Model::V] = weights.v;
+  r[Model::DELTA] = weights.delta;
+  r[Model::A] = weights.a;
+  if (terminal_P.empty() || terminal_model != model || terminal_dt != dt_last ||
+      terminal_integrator != integrator || terminal_substeps != substeps ||
+      terminal_q.size() != q.size() || terminal_q != q || terminal_r != r)
+  {
+    terminal_P.clear();
+    for (size_t b=0; b<n_terminal_bands; b++)
+    {
+      // Linearize at the center of the band, at least slightly moving.
+      double v_band = max(b * terminal_band_width, 1.0);
+      terminal_P.push_back(TerminalCostMatrix<Model>(v_band, dt_last, integrator,
+                                                     substeps, q, r));
+    }
+    terminal_model = model;
+    terminal_dt = dt_last;
+    terminal_integrator = integrator;
+    terminal_substeps = substeps;
+    terminal_q = q;
+    terminal_r = r;
+  }
+  size_t band = (size_t)max(0.0, v / terminal_band_width + 0.5);
+  return terminal_P[min(band, n_terminal_bands - 1)];
+}
+
+template <class Model>
+vector<double> MPC::SolveHorizon(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                                 size_t n_delay, double delay_dt,
+                                 double delta_prev, double a_prev, double warm_shift) {
   bool ok = true;
   //size_t i; // UNECESSARY
   typedef CPPAD_TESTVECTOR(double) Dvector;
-  // Initial state info
-  double x    = state[0];
-  double y    = state[1];
-  double psi  = state[2];
-  double v    = state[3];
-  double cte  = state[4];
-  double epsi = state[5];
+  assert(state.size() == Model::n_states);
+  // The first n_delay intervals cover the actuator delay, the plan starts
+  // at state n_delay, i.e. at the actuation time. The planned intervals
+  // follow the time grid if there is one, else N - 1 intervals of dt.
+  vector<double> dts(n_delay, delay_dt);
+  if (time_grid.empty())
+  {
+    dts.resize(n_delay + N - 1, dt);
+  }
+  else
+  {
+    dts.insert(dts.end(), time_grid.begin(), time_grid.end());
+  }
+  // The actuators are held over the blocks of `move_blocks`.
+  Layout<Model> layout(dts.size() + 1, ActuatorBlocks(n_delay, dts.size(), move_blocks));
+  const size_t n = layout.n;
+  // Start time of each planned interval relative to the actuation time.
+  vector<double> starts;
+  double start = 0;
+  for (size_t t=n_delay; t<n-1; t++)
+  {
+    starts.push_back(start);
+    start += dts[t];
+  }
+  // Parameters of each stage, evaluated here once instead of in the tape.
+  vector<double> params(n * Model::n_params);
+  double time = 0;
+  for (size_t t=0; t<n; t++)
+  {
+    Model::stage_params(state.data(), coeffs, time, params.data() + t * Model::n_params);
+    if (t < n - 1) { time += dts[t]; }
+  }
   // Set the number of model variables (includes both states and inputs).
   // For example: If the state is a 4 element vector, the actuators is a 2
   // element vector and there are 10 timesteps. The number of variables is:
   // 4 * 10 + 2 * 9
-  size_t n_vars = N * 6 + (N - 1) * 2;
+  size_t n_vars = layout.n_vars();
   // Set the number of constraints
-  size_t n_constraints = N * 6;
+  size_t n_constraints = layout.n_constraints();
   // Initial value of the independent variables.
   // SHOULD BE 0 besides initial state.
   Dvector vars(n_vars);
   for (size_t i=0; i<n_vars; i++) { vars[i] = 0.0; }
   // Set the initial variable values
-  vars[x_start]    = x;
-  vars[y_start]    = y;
-  vars[psi_start]  = psi;
-  vars[v_start]    = v;
-  vars[cte_start]  = cte;
-  vars[epsi_start] = epsi;
+  for (size_t i=0; i<Model::n_states; i++)
+  {
+    vars[layout.state_start(i)] = state[i];
+  }
   // Lower and upper limits for x
   Dvector vars_lowerbound(n_vars);
   Dvector vars_upperbound(n_vars);
   // Set all non-actuators upper and lowerlimits
   // to the max negative and positive values.
-  for (size_t i=0; i<delta_start; i++)
+  for (size_t i=0; i<layout.input_start(0); i++)
   {
     vars_lowerbound[i] = -1.0e19;
     vars_upperbound[i] =  1.0e19;
   }
-  // The upper and lower limits of delta are set to -25 and 25
-  // degrees (values in radians).
-  for (int i = delta_start; i < a_start; i++)
+  // Actuator limits given by the model.
+  for (size_t j=0; j<Model::n_inputs; j++)
+  {
+    for (size_t b=0; b<layout.n_blocks; b++)
+    {
+      vars_lowerbound[layout.input_start(j) + b] = Model::input_lower(j);
+      vars_upperbound[layout.input_start(j) + b] = Model::input_upper(j);
+    }
+  }
+  // The actuators during the delay were already sent to the vehicle, so they
+  // are fixed to the committed values. They stay variables so that the
+  // problem keeps the same structure whatever the latency.
+  double committed[Model::n_inputs] = {};
+  committed[Model::DELTA] = delta_prev;
+  committed[Model::A] = a_prev;
+  for (size_t j=0; j<Model::n_inputs; j++)
   {
-    vars_lowerbound[i] = -0.436332;
-    vars_upperbound[i] = 0.436332;
+    double u = max(Model::input_lower(j), min(Model::input_upper(j), committed[j]));
+    for (size_t t=0; t<n_delay; t++)
+    {
+      vars[layout.input(j, t)] = u;
+      vars_lowerbound[layout.input(j, t)] = u;
+      vars_upperbound[layout.input(j, t)] = u;
+    }
   }
-  // Acceleration/decceleration upper and lower limits.
-  for (int i = a_start; i < n_vars; i++)
+  // Warm start. The planned actuators start from the previous plan moved on
+  // by `warm_shift` seconds, each block taking the value at the start of its
+  // first interval. Since the plans are compared in time, this also holds
+  // for non-uniform time grids. The states start from a rollout of the
+  // model, so that the initial guess satisfies the dynamics constraints.
+  if (warm_start)
   {
-    vars_lowerbound[i] = -1.0;
-    vars_upperbound[i] =  1.0;
+    if (warm_model == model && !warm_inputs.empty())
+    {
+      for (size_t t=n_delay; t<n-1; t++)
+      {
+        if (t > 0 && layout.block[t] == layout.block[t - 1]) { continue; }
+        for (size_t j=0; j<Model::n_inputs; j++)
+        {
+          double u = PlanValueAt(warm_starts, warm_inputs[j],
+                                 starts[t - n_delay] + warm_shift);
+          vars[layout.input(j, t)] = max(Model::input_lower(j), min(Model::input_upper(j), u));
+        }
+      }
+    }
+    double s0[Model::n_states];
+    double u0[Model::n_inputs];
+    double s1[Model::n_states];
+    for (size_t i=0; i<Model::n_states; i++) { s0[i] = state[i]; }
+    for (size_t t=0; t<n-1; t++)
+    {
+      for (size_t j=0; j<Model::n_inputs; j++) { u0[j] = vars[layout.input(j, t)]; }
+      Model::step(s0, u0, params.data() + t * Model::n_params, coeffs, dts[t],
+                  integrator, substeps, s1);
+      for (size_t i=0; i<Model::n_states; i++)
+      {
+        vars[layout.state_start(i) + t + 1] = s1[i];
+        s0[i] = s1[i];
+      }
+    }
   }
   // Lower and upper limits for the constraints
   // Should be 0 besides initial state.
@@ -213,21 +323,18 @@ vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
     constraints_lowerbound[i] = 0;
     constraints_upperbound[i] = 0;
   }
-  constraints_lowerbound[x_start]    = x;
-  constraints_lowerbound[y_start]    = y;
-  constraints_lowerbound[psi_start]  = psi;
-  constraints_lowerbound[v_start]    = v;
-  constraints_lowerbound[cte_start]  = cte;
-  constraints_lowerbound[epsi_start] = epsi;
-  
-  constraints_upperbound[x_start]    = x;
-  constraints_upperbound[y_start]    = y;
-  constraints_upperbound[psi_start]  = psi;
-  constraints_upperbound[v_start]    = v;
-  constraints_upperbound[cte_start]  = cte;
-  constraints_upperbound[epsi_start] = epsi;
+  for (size_t i=0; i<Model::n_states; i++)
+  {
+    constraints_lowerbound[layout.state_start(i)] = state[i];
+    constraints_upperbound[layout.state_start(i)] = state[i];
+  }
   // object that computes objective and constraints
-  FG_eval fg_eval(coeffs);
+  FG_eval<Model> fg_eval(coeffs, layout, dts, params, integrator, substeps, weights);
+  // Terminal cost of the band of the current speed.
+  if (terminal_cost)
+  {
+    fg_eval.terminal = TerminalCost<Model>(state[Model::V], dts.back());
+  }
   // Options for IPOPT solver
   std::string options;
   // Uncomment this if you'd like more print information
@@ -242,29 +349,52 @@ vector<double> MPC::Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs) {
   // NOTE: Currently the solver has a maximum time limit of 0.5 seconds.
   // Change this as you see fit.
   options += "Numeric max_cpu_time          0.5\n";
+  options += ipopt_options;
   // place to return solution
   CppAD::ipopt::solve_result<Dvector> solution;
-  // solve the problem
-  CppAD::ipopt::solve<Dvector, FG_eval>(
-      options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
-      constraints_upperbound, fg_eval, solution);
+  // solve the problem, see ipopt_stats.h
+  SolveWithStats(options, vars, vars_lowerbound, vars_upperbound, constraints_lowerbound,
+                 constraints_upperbound, fg_eval, solution, last_stats, cancelled);
   // Check some of the solution values
   ok &= solution.status == CppAD::ipopt::solve_result<Dvector>::success;
+  last_ok = ok;
   // Cost
   auto cost = solution.obj_value;
-  std::cout << "Cost " << cost << std::endl;
+  if (verbose) { Log(LOG_INFO, "Cost {} Iterations {}", cost, last_stats.iterations); }
   // TODO: Return the first actuator values. The variables can be accessed with
   // `solution.x[i]`.
   // {...} is shorthand for creating a vector, so auto x1 = {1.0,2.0}
   // creates a 2 element double vector.
   vector<double> pred_info;
-  // First, save the actuator values
-  pred_info.push_back(solution.x[delta_start]);
-  pred_info.push_back(solution.x[a_start]);
-  // Second, save
-  for (size_t t=0; t<N-1; t++) {
-    pred_info.push_back(solution.x[x_start+t+1]);
-    pred_info.push_back(solution.x[y_start+t+1]);
+  // First, save the actuator values at the actuation time
+  pred_info.push_back(solution.x[layout.input(Model::DELTA, n_delay)]);
+  pred_info.push_back(solution.x[layout.input(Model::A, n_delay)]);
+  // Second, save the planned trajectory after the actuation time
+  for (size_t t=n_delay; t<n-1; t++) {
+    double s[Model::n_states];
+    for (size_t i=0; i<Model::n_states; i++)
+    {
+      s[i] = solution.x[layout.state_start(i) + t + 1];
+    }
+    double px, py;
+    Model::position(s, coeffs, px, py);
+    pred_info.push_back(px);
+    pred_info.push_back(py);
+  }
+  // Keep the planned actuators of each interval for the next warm start.
+  warm_model = model;
+  warm_inputs.clear();
+  warm_starts = starts;
+  if (ok)
+  {
+    warm_inputs.resize(Model::n_inputs);
+    for (size_t j=0; j<Model::n_inputs; j++)
+    {
+      for (size_t t=n_delay; t<n-1; t++)
+      {
+        warm_inputs[j].push_back(solution.x[layout.input(j, t)]);
+      }
+    }
   }
   
   return pred_info;
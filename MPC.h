@@ -1,8 +1,14 @@
 #ifndef MPC_H
 #define MPC_H
 
+#include <functional>
+#include <string>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
+#include "cost_weights.h"
+#include "integrator.h"
+#include "solve_stats.h"
+#include "vehicle_model.h"
 
 using namespace std;
 
@@ -20,7 +26,112 @@ public:
   // Solve the model given an initial state and polynomial coefficients.
   // Return the first actuatotions.
   vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs);
-  
+
+  // Solve the model with an explicit actuator delay. `state` is the state at
+  // the time the telemetry was sampled. The first `delay_steps` intervals of
+  // the horizon span `latency` seconds and apply the actuators already
+  // committed to the vehicle, so the returned plan starts at actuation time.
+  vector<double> Solve(Eigen::VectorXd state, Eigen::VectorXd coeffs,
+                       double latency, double delta_prev, double a_prev);
+
+  // Build the state of the selected model at the telemetry sample, in the
+  // vehicle coordinate system, from the measured speed, errors and steering.
+  Eigen::VectorXd InitialState(double v, double cte, double epsi, double delta) const;
+
+  // Take over the plan of another solver as warm start, e.g. when switching
+  // between solvers with different horizons.
+  void CopyWarmStart(const MPC &other);
+
+  // Hold the warm start back by `seconds`, so that the next call to Solve
+  // does not move it on, e.g. when the last plan was already solved for the
+  // time of the next telemetry.
+  void HoldWarmStart(double seconds);
+
+  // Whether the last solve converged.
+  bool LastSolveOk() const { return last_ok; }
+  // Iterations, evaluation times and final infeasibility of the last solve.
+  const SolveStats &LastSolveStats() const { return last_stats; }
+
+  // Number of planned states and the duration of each planned interval.
+  size_t N;
+  double dt;
+
+  // Non-uniform time grid: the duration of each planned interval, e.g. short
+  // steps near-term growing towards the end of the horizon. When it is not
+  // empty it replaces N and dt, with time_grid.size() + 1 planned states.
+  vector<double> time_grid;
+
+  // Vehicle model of the dynamics constraints, see vehicle_model.h.
+  ModelType model;
+
+  // Number of horizon intervals the actuator delay is split into.
+  size_t delay_steps;
+
+  // Integration scheme of the model over each interval, including the delay
+  // steps. `substeps` is only used by EULER_SUBSTEPS.
+  Integrator integrator;
+  size_t substeps;
+
+  // Move blocking: the planned actuators are held constant over blocks of
+  // this many intervals, e.g. {1, 1, 2, 2, 3}. The last block extends to the
+  // end of the horizon. Empty means one actuator value per interval.
+  vector<size_t> move_blocks;
+
+  // Start each solve from the previous plan, moved on by the time elapsed
+  // since the previous call.
+  bool warm_start;
+
+  // Add a quadratic terminal cost on the last state, the infinite horizon
+  // LQR cost of the model linearized at the current speed band. It lets a
+  // short horizon behave like a longer one.
+  bool terminal_cost;
+
+  // Weights of the cost function and reference speed, used from the next
+  // call to Solve on.
+  CostWeights weights;
+
+  // Print the cost of every solve.
+  bool verbose;
+
+  // Extra Ipopt options appended to the defaults, in the format of
+  // CppAD::ipopt::solve, e.g. "Integer max_iter 1\n".
+  string ipopt_options;
+
+  // Called at every Ipopt iteration, from the thread that solves. Once it
+  // returns true the solve stops and fails, e.g. when its result is no
+  // longer needed. Not set by default.
+  std::function<bool()> cancelled;
+
+private:
+  bool last_ok;
+  SolveStats last_stats;
+
+  // Planned actuators of the last successful solve, per actuator and
+  // interval, the start time of each interval and the model they belong to.
+  ModelType warm_model;
+  vector<vector<double> > warm_inputs;
+  vector<double> warm_starts;
+
+  // Terminal cost matrices of each speed band and what they were computed for.
+  vector<Eigen::MatrixXd> terminal_P;
+  ModelType terminal_model;
+  double terminal_dt;
+  Integrator terminal_integrator;
+  size_t terminal_substeps;
+  Eigen::VectorXd terminal_q;
+  Eigen::VectorXd terminal_r;
+
+  template <class Model>
+  Eigen::MatrixXd TerminalCost(double v, double dt_last);
+
+  vector<double> SolveModel(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                            size_t n_delay, double delay_dt,
+                            double delta_prev, double a_prev, double warm_shift);
+
+  template <class Model>
+  vector<double> SolveHorizon(const Eigen::VectorXd &state, const Eigen::VectorXd &coeffs,
+                              size_t n_delay, double delay_dt,
+                              double delta_prev, double a_prev, double warm_shift);
 };
 
 #endif /* MPC_H */
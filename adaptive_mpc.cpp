@@ -0,0 +1,129 @@
+#include "adaptive_mpc.h"
+#include <chrono>
+
+AdaptiveMPC::AdaptiveMPC()
+{
+  vector<HorizonConfig> rows;
+  rows.push_back({0.0, 10, 0.1});
+  // Half of the 100 ms actuation latency.
+  Init(rows, 0.05, MPC());
+}
+
+AdaptiveMPC::AdaptiveMPC(const vector<HorizonConfig> &table, double solve_budget)
+{
+  Init(table, solve_budget, MPC());
+}
+
+AdaptiveMPC::~AdaptiveMPC() {}
+
+vector<HorizonConfig> AdaptiveMPC::SpeedTable()
+{
+  vector<HorizonConfig> rows;
+  rows.push_back({0.0, 8, 0.1});
+  rows.push_back({15.0, 10, 0.1});
+  rows.push_back({35.0, 10, 0.15});
+  return rows;
+}
+
+void AdaptiveMPC::SetTable(const vector<HorizonConfig> &table, double solve_budget)
+{
+  // The settings of the current solvers carry over to the new rows.
+  MPC prototype = solvers[0];
+  Init(table, solve_budget, prototype);
+}
+
+void AdaptiveMPC::Init(const vector<HorizonConfig> &table, double solve_budget,
+                       const MPC &prototype)
+{
+  this->table = table;
+  this->solve_budget = solve_budget;
+  solve_time_aging = 0.99;
+  solvers.assign(table.size(), prototype);
+  for (size_t i=0; i<table.size(); i++)
+  {
+    solvers[i].N = table[i].N;
+    solvers[i].dt = table[i].dt;
+    solvers[i].time_grid.clear();
+  }
+  solve_time.assign(table.size(), 0.0);
+  solves.assign(table.size(), 0);
+  idle.assign(table.size(), 0);
+  current = 0;
+}
+
+void AdaptiveMPC::SetWeights(const CostWeights &weights)
+{
+  for (size_t i=0; i<solvers.size(); i++) { solvers[i].weights = weights; }
+}
+
+void AdaptiveMPC::SetCancelled(const std::function<bool()> &cancelled)
+{
+  for (size_t i=0; i<solvers.size(); i++) { solvers[i].cancelled = cancelled; }
+}
+
+void AdaptiveMPC::HoldWarmStart(double seconds)
+{
+  for (size_t i=0; i<solvers.size(); i++) { solvers[i].HoldWarmStart(seconds); }
+}
+
+void AdaptiveMPC::CopyWarmStart(const AdaptiveMPC &other)
+{
+  if (other.solvers.size() != solvers.size()) { return; }
+  for (size_t i=0; i<solvers.size(); i++) { solvers[i].CopyWarmStart(other.solvers[i]); }
+  current = other.current;
+}
+
+size_t AdaptiveMPC::Select(double v) const
+{
+  // Preferred row for the speed.
+  size_t i = 0;
+  while (i + 1 < table.size() && v >= table[i + 1].v_min) { i++; }
+  // Step down to rows with fewer planned states while the measured solve
+  // time does not fit in the budget.
+  while (solve_time[i] > solve_budget)
+  {
+    size_t cheaper = i;
+    for (size_t k=0; k<table.size(); k++)
+    {
+      if (table[k].N < table[i].N && (cheaper == i || table[k].N > table[cheaper].N))
+      {
+        cheaper = k;
+      }
+    }
+    if (cheaper == i) { break; }
+    i = cheaper;
+  }
+  return i;
+}
+
+vector<double> AdaptiveMPC::Solve(double v, Eigen::VectorXd state, Eigen::VectorXd coeffs,
+                                  double latency, double delta_prev, double a_prev)
+{
+  size_t next = Select(v);
+  if (next != current)
+  {
+    solvers[next].CopyWarmStart(solvers[current]);
+    current = next;
+  }
+  auto start = std::chrono::steady_clock::now();
+  vector<double> pred_info = solvers[current].Solve(state, coeffs, latency, delta_prev, a_prev);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  for (size_t i=0; i<table.size(); i++)
+  {
+    if (i != current)
+    {
+      solve_time[i] *= solve_time_aging;
+      idle[i]++;
+    }
+  }
+  // Over a second unused, the value is mostly aging, not measurements.
+  bool aged = idle[current] >= 10;
+  idle[current] = 0;
+  // The first solve of a row sets up the solver and may start cold, it
+  // says little about the next ones.
+  if (solves[current]++ == 0) { return pred_info; }
+  // Exponential moving average, so a single slow cycle does not switch.
+  double &avg = solve_time[current];
+  avg = (avg == 0 || aged) ? elapsed.count() : 0.8 * avg + 0.2 * elapsed.count();
+  return pred_info;
+}
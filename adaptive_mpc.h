@@ -0,0 +1,98 @@
+#ifndef ADAPTIVE_MPC_H
+#define ADAPTIVE_MPC_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+
+using namespace std;
+
+// One row of the horizon table of AdaptiveMPC.
+struct HorizonConfig {
+  // Lowest speed the row applies to, in m/s.
+  double v_min;
+  // Number of planned states and duration of each planned interval.
+  size_t N;
+  double dt;
+};
+
+// MPC that picks its horizon length and step size every cycle from a table
+// indexed by the current speed, and falls back to shorter horizons when the
+// measured solve time of the preferred one exceeds the compute budget.
+// There is one MPC instance per row, built once, so a switch never
+// reconfigures a solver. The instance taking over inherits the plan of the
+// previous one as warm start, since warm starts are compared in time.
+class AdaptiveMPC {
+public:
+  // A single row with the tuned (N, dt) = (10, 0.1) of the README, i.e. a
+  // plain MPC. See SpeedTable.
+  AdaptiveMPC();
+  // `table` must be sorted by v_min, `solve_budget` is in seconds.
+  AdaptiveMPC(const vector<HorizonConfig> &table, double solve_budget);
+  virtual ~AdaptiveMPC();
+
+  // A table following the (N, dt) experiments of the README: a short
+  // preview at low speed, (10, 0.1) from 15 m/s, and a longer step from
+  // 35 m/s to look further ahead with the same variables.
+  static vector<HorizonConfig> SpeedTable();
+
+  // Replace the table. The solvers are rebuilt from the first one, so
+  // they keep its settings, e.g. the model, with the N and dt of each row.
+  void SetTable(const vector<HorizonConfig> &table, double solve_budget);
+
+  // Same as MPC::Solve with an actuator delay, `v` being the current speed.
+  vector<double> Solve(double v, Eigen::VectorXd state, Eigen::VectorXd coeffs,
+                       double latency, double delta_prev, double a_prev);
+
+  // Row used by the last call to Solve.
+  size_t Selected() const { return current; }
+  // Whether the last solve converged.
+  bool LastSolveOk() const { return solvers[current].LastSolveOk(); }
+  const SolveStats &LastSolveStats() const { return solvers[current].LastSolveStats(); }
+  const HorizonConfig &Config(size_t i) const { return table[i]; }
+
+  // Smoothed solve time of each row in seconds, 0 until it has been
+  // measured. The first, cold, solve of a row is not counted.
+  double SolveTime(size_t i) const { return solve_time[i]; }
+
+  // Set the cost weights of all the rows, from the next call to Solve on.
+  void SetWeights(const CostWeights &weights);
+  const CostWeights &Weights() const { return solvers[0].weights; }
+
+  // Set MPC::cancelled of all the rows, an empty function to clear it.
+  void SetCancelled(const std::function<bool()> &cancelled);
+
+  // Hold the warm start of all the rows back by `seconds`, see
+  // MPC::HoldWarmStart.
+  void HoldWarmStart(double seconds);
+
+  // Take over the plans of all the rows and the selected row of another
+  // instance with the same table, e.g. a copy that solved in another thread.
+  void CopyWarmStart(const AdaptiveMPC &other);
+
+  // The solver of each row, e.g. to set the model or the integrator. All of
+  // them should use the same model.
+  vector<MPC> solvers;
+
+  // Compute budget of one solve in seconds.
+  double solve_budget;
+
+  // Factor applied every cycle to the smoothed solve time of the rows not
+  // in use. A row left for being too slow is therefore tried again after a
+  // while, 0.99 being about 7 s at 10 Hz when it was twice the budget, and
+  // its first solve then replaces the aged value.
+  double solve_time_aging;
+
+private:
+  vector<HorizonConfig> table;
+  vector<double> solve_time;
+  // Solves of each row so far, and cycles since each row was last used.
+  vector<size_t> solves;
+  vector<size_t> idle;
+  size_t current;
+
+  void Init(const vector<HorizonConfig> &table, double solve_budget, const MPC &prototype);
+  size_t Select(double v) const;
+};
+
+#endif /* ADAPTIVE_MPC_H */
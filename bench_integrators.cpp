@@ -0,0 +1,122 @@
+// Accuracy/compute trade-off of the integration schemes of the MPC model.
+//
+// For each scheme and interval length dt this reports
+//  - the position and heading error of the prediction over one interval and
+//    over a 1 s horizon, against RK4 with a step of dt / 100,
+//  - the average time of MPC::Solve with N * dt = 1 s.
+//
+// Build it next to the controller, e.g.
+//   g++ -O2 -std=c++11 -pthread bench_integrators.cpp MPC.cpp lqr.cpp cost_weights.cpp
+//       trace.cpp perf_counters.cpp logger.cpp -lipopt -o bench_integrators
+#include <math.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "MPC.h"
+#include "vehicle_model.h"
+
+struct Scheme {
+  const char *name;
+  Integrator integrator;
+  size_t substeps;
+};
+
+// Roll out the model from `s0` for `steps` intervals of length `dt` with
+// constant actuators.
+void rollout(const double *s0, double delta, double a, const Eigen::VectorXd &coeffs,
+             double dt, size_t steps, Integrator integrator, size_t substeps,
+             double *s)
+{
+  for (size_t i=0; i<6; i++) { s[i] = s0[i]; }
+  for (size_t k=0; k<steps; k++)
+  {
+    double u[2] = {delta, a};
+    double s1[6];
+    KinematicModel::step(s, u, NULL, coeffs, dt, integrator, substeps, s1);
+    for (size_t i=0; i<6; i++) { s[i] = s1[i]; }
+  }
+}
+
+// Errors of the pure kinematic states [x, y, psi], cte and epsi are
+// recomputed from the reference line at every step and therefore depend on
+// the step length by construction.
+void predictionError(const Scheme &scheme, double dt, double horizon,
+                     double &pos_err, double &psi_err)
+{
+  // A bend similar to the sharp turns of the track.
+  Eigen::VectorXd coeffs(4);
+  coeffs << 0.5, 0.05, 0.004, -0.00005;
+  const double speeds[] = {10, 30, 50};
+  const double deltas[] = {-0.4, -0.1, 0.0, 0.2, 0.4};
+  const double accels[] = {-1, 0, 1};
+  size_t steps = (size_t)(horizon / dt + 0.5);
+  pos_err = 0;
+  psi_err = 0;
+  for (double v : speeds)
+  {
+    for (double delta : deltas)
+    {
+      for (double a : accels)
+      {
+        double s0[6] = {0, 0, 0, v, coeffs[0], -atan(coeffs[1])};
+        double s[6], ref[6];
+        rollout(s0, delta, a, coeffs, dt, steps, scheme.integrator,
+                scheme.substeps, s);
+        rollout(s0, delta, a, coeffs, dt / 100, steps * 100, RK4, 1, ref);
+        pos_err = fmax(pos_err, hypot(s[0] - ref[0], s[1] - ref[1]));
+        psi_err = fmax(psi_err, fabs(s[2] - ref[2]));
+      }
+    }
+  }
+}
+
+// Average time of MPC::Solve in milliseconds.
+double solveTime(const Scheme &scheme, double dt, size_t n_solves)
+{
+  MPC mpc;
+  mpc.dt = dt;
+  mpc.N = (size_t)(1.0 / dt + 0.5);
+  mpc.integrator = scheme.integrator;
+  mpc.substeps = scheme.substeps;
+  Eigen::VectorXd coeffs(4);
+  coeffs << 0.5, 0.05, 0.004, -0.00005;
+  Eigen::VectorXd state(6);
+  state << 0, 0, 0, 30, coeffs[0], -atan(coeffs[1]);
+  // Warm up the allocator and the solver.
+  mpc.Solve(state, coeffs, 0.1, 0.0, 0.5);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i=0; i<n_solves; i++)
+  {
+    mpc.Solve(state, coeffs, 0.1, 0.0, 0.5);
+  }
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / n_solves;
+}
+
+int main()
+{
+  const Scheme schemes[] = {
+    {"euler", EULER, 1},
+    {"euler x2", EULER_SUBSTEPS, 2},
+    {"euler x4", EULER_SUBSTEPS, 4},
+    {"rk2", RK2, 1},
+    {"rk4", RK4, 1},
+  };
+  const double dts[] = {0.05, 0.1, 0.15, 0.2};
+  printf("%-10s %6s %14s %14s %14s %14s %12s\n", "scheme", "dt",
+         "step pos [m]", "step psi [rad]", "1s pos [m]", "1s psi [rad]",
+         "solve [ms]");
+  for (const Scheme &scheme : schemes)
+  {
+    for (double dt : dts)
+    {
+      double step_pos, step_psi, pos, psi;
+      predictionError(scheme, dt, dt, step_pos, step_psi);
+      predictionError(scheme, dt, 1.0, pos, psi);
+      printf("%-10s %6.2f %14.3e %14.3e %14.3e %14.3e %12.3f\n", scheme.name, dt,
+             step_pos, step_psi, pos, psi, solveTime(scheme, dt, 20));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,403 @@
+// Microbenchmarks of the stages of the control loop, from the websocket
+// message to the steer reply, on a telemetry frame of the lake track.
+//
+// The solver benchmarks take the number of planned states N as argument.
+// FG_eval is measured both when it is taped with AD<double>, as Ipopt's
+// CppAD interface does at every solve, and when the taped function is
+// evaluated in double precision.
+//
+// Build it next to the controller with Google Benchmark, e.g.
+//   g++ -O2 -std=c++11 bench_mpc.cpp controller.cpp adaptive_mpc.cpp MPC.cpp lqr.cpp
+//       cost_weights.cpp trace.cpp perf_counters.cpp logger.cpp reply_writer.cpp
+//       wire_format.cpp -lipopt -lbenchmark -lpthread -o bench_mpc
+// and compare runs with --benchmark_out=before.json --benchmark_out_format=json.
+//
+// With --perf each benchmark also reports hardware counters per iteration,
+// see perf_counters.h: cycles, instructions per cycle, cache and branch
+// misses per thousand instructions, and the cycles of the stages measured
+// inside the controller, e.g. nlp_eval and ipopt in the solves.
+#include <math.h>
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cppad/cppad.hpp>
+#include "Eigen-3.3/Eigen/Core"
+#include "FG_eval.h"
+#include "MPC.h"
+#include "controller.h"
+#include "json.hpp"
+#include "perf_counters.h"
+#include "reply_writer.h"
+#include "vehicle_model.h"
+#include "wire_format.h"
+
+using json = nlohmann::json;
+
+// First telemetry message of the simulator on the lake track.
+const string frame =
+  "42[\"telemetry\",{\"ptsx\":[-32.16173,-43.49173,-61.09,-78.29172,-93.05002,"
+  "-107.7717],\"ptsy\":[113.361,105.941,92.88499,78.73102,65.34102,50.57938],"
+  "\"psi_unity\":4.12033,\"psi\":3.733651,\"x\":-40.62,\"y\":108.73,"
+  "\"steering_angle\":0.05,\"throttle\":0.3,\"speed\":40}]";
+
+// The frame decoded and preprocessed as in the control loop.
+struct Frame {
+  Telemetry telemetry;
+  Eigen::VectorXd xvals;
+  Eigen::VectorXd yvals;
+  Eigen::VectorXd coeffs;
+  Eigen::VectorXd state;
+
+  Frame()
+  {
+    json j = json::parse(hasData(frame));
+    telemetry.ptsx = j[1]["ptsx"].get<vector<double> >();
+    telemetry.ptsy = j[1]["ptsy"].get<vector<double> >();
+    telemetry.x = j[1]["x"];
+    telemetry.y = j[1]["y"];
+    telemetry.psi = j[1]["psi"];
+    telemetry.speed = j[1]["speed"];
+    telemetry.steering_angle = j[1]["steering_angle"];
+    telemetry.throttle = j[1]["throttle"];
+    xvals.resize(telemetry.ptsx.size());
+    yvals.resize(telemetry.ptsx.size());
+    globalToLocal(telemetry.ptsx, telemetry.ptsy, telemetry.x, telemetry.y, telemetry.psi,
+                  xvals, yvals);
+    coeffs = polyfit(xvals, yvals, 3);
+    MPC mpc;
+    state = mpc.InitialState(telemetry.speed * 0.44704, polyeval(coeffs, 0),
+                             -atan(coeffs[1]), telemetry.steering_angle);
+  }
+};
+
+const Frame &TheFrame()
+{
+  static Frame f;
+  return f;
+}
+
+const double latency = 0.1;
+
+// Whether to report hardware counters, with --perf.
+bool perf = false;
+
+// Report the hardware counters of the benchmark loop per iteration. Start
+// it right before the loop.
+class BenchPerf {
+public:
+  BenchPerf(benchmark::State &st) : st(st)
+  {
+    if (!perf) { return; }
+    for (size_t i=0; i<N_PERF_STAGES; i++)
+    {
+      stage_start[i] = PerfStageTotal((PerfStage)i);
+      stage_calls[i] = PerfStageCount((PerfStage)i);
+    }
+    start = counters.Read();
+  }
+  ~BenchPerf()
+  {
+    if (!perf) { return; }
+    PerfSample d = counters.Read() - start;
+    const benchmark::Counter::Flags avg = benchmark::Counter::kAvgIterations;
+    st.counters["cycles"] = benchmark::Counter(d.cycles, avg);
+    st.counters["IPC"] = d.cycles > 0 ? (double)d.instructions / d.cycles : 0.0;
+    double kinstr = d.instructions > 0 ? d.instructions / 1000.0 : 1;
+    st.counters["cache_miss/ki"] = d.cache_misses / kinstr;
+    st.counters["branch_miss/ki"] = d.branch_misses / kinstr;
+    for (size_t i=0; i<N_PERF_STAGES; i++)
+    {
+      PerfStage stage = (PerfStage)i;
+      if (PerfStageCount(stage) == stage_calls[i]) { continue; }
+      PerfSample s = PerfStageTotal(stage) - stage_start[i];
+      st.counters[string(PerfStageName(stage)) + "_cycles"] = benchmark::Counter(s.cycles, avg);
+    }
+  }
+
+private:
+  benchmark::State &st;
+  PerfCounters counters;
+  PerfSample start;
+  PerfSample stage_start[N_PERF_STAGES];
+  uint64_t stage_calls[N_PERF_STAGES];
+};
+
+static void BM_HasData(benchmark::State &st)
+{
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(hasData(frame));
+  }
+}
+BENCHMARK(BM_HasData);
+
+static void BM_JsonParse(benchmark::State &st)
+{
+  string s = hasData(frame);
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(json::parse(s));
+  }
+}
+BENCHMARK(BM_JsonParse);
+
+// The same telemetry in a binary frame, the argument being the WireFormat.
+static void BM_DecodeTelemetry(benchmark::State &st)
+{
+  WireFormat format = WireFormat(st.range(0));
+  vector<char> data;
+  EncodeTelemetry(format, TheFrame().telemetry, NAN, data);
+  Telemetry telemetry;
+  double time;
+  string error;
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(DecodeTelemetry(format, data.data(), data.size(), telemetry,
+                                             time, error));
+  }
+}
+BENCHMARK(BM_DecodeTelemetry)->Arg(WIRE_MSGPACK)->Arg(WIRE_CBOR)->Arg(WIRE_PACKED);
+
+static void BM_GlobalToLocal(benchmark::State &st)
+{
+  Telemetry t = TheFrame().telemetry;
+  Eigen::VectorXd xvals(t.ptsx.size());
+  Eigen::VectorXd yvals(t.ptsx.size());
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    globalToLocal(t.ptsx, t.ptsy, t.x, t.y, t.psi, xvals, yvals);
+    benchmark::DoNotOptimize(xvals.data());
+    benchmark::DoNotOptimize(yvals.data());
+  }
+}
+BENCHMARK(BM_GlobalToLocal);
+
+static void BM_Polyfit(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(polyfit(f.xvals, f.yvals, 3));
+  }
+}
+BENCHMARK(BM_Polyfit);
+
+static void BM_Polyeval(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  double x = 0;
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(polyeval(f.coeffs, x));
+    x += 1e-3;
+  }
+}
+BENCHMARK(BM_Polyeval);
+
+// The prediction of the state over the latency with the actuators already
+// committed, i.e. the delay steps at the start of the horizon.
+static void BM_LatencyPredictor(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  MPC mpc;
+  double u[2] = {f.telemetry.steering_angle, f.telemetry.throttle};
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    double s[KinematicModel::n_states];
+    for (size_t i=0; i<KinematicModel::n_states; i++) { s[i] = f.state[i]; }
+    for (size_t k=0; k<mpc.delay_steps; k++)
+    {
+      double s1[KinematicModel::n_states];
+      KinematicModel::step(s, u, NULL, f.coeffs, latency / mpc.delay_steps, mpc.integrator,
+                           mpc.substeps, s1);
+      for (size_t i=0; i<KinematicModel::n_states; i++) { s[i] = s1[i]; }
+    }
+    benchmark::DoNotOptimize(s);
+  }
+}
+BENCHMARK(BM_LatencyPredictor);
+
+// FG_eval of a horizon of N states with the defaults of MPC, started at
+// the state of the frame with zero actuators.
+struct FGFixture {
+  Layout<KinematicModel> layout;
+  FG_eval<KinematicModel> fg_eval;
+  CPPAD_TESTVECTOR(double) x;
+
+  FGFixture(size_t N)
+    : layout(N),
+      fg_eval(TheFrame().coeffs, layout, vector<double>(N - 1, 0.1), vector<double>(),
+              EULER, 1, CostWeights()),
+      x(layout.n_vars())
+  {
+    for (size_t i=0; i<layout.n_vars(); i++) { x[i] = 0; }
+    for (size_t i=0; i<KinematicModel::n_states; i++)
+    {
+      for (size_t t=0; t<N; t++) { x[layout.state_start(i) + t] = TheFrame().state[i]; }
+    }
+  }
+
+  // Tape the cost and the constraints.
+  void Tape(CppAD::ADFun<double> &f)
+  {
+    CPPAD_TESTVECTOR(AD<double>) ax(layout.n_vars());
+    CPPAD_TESTVECTOR(AD<double>) afg(1 + layout.n_constraints());
+    for (size_t i=0; i<layout.n_vars(); i++) { ax[i] = x[i]; }
+    CppAD::Independent(ax);
+    fg_eval(afg, ax);
+    f.Dependent(ax, afg);
+  }
+};
+
+static void BM_FGEvalAD(benchmark::State &st)
+{
+  FGFixture fixture(st.range(0));
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    CppAD::ADFun<double> f;
+    fixture.Tape(f);
+    benchmark::DoNotOptimize(f);
+  }
+}
+BENCHMARK(BM_FGEvalAD)->Arg(6)->Arg(10)->Arg(15)->Arg(20);
+
+static void BM_FGEvalDouble(benchmark::State &st)
+{
+  FGFixture fixture(st.range(0));
+  CppAD::ADFun<double> f;
+  fixture.Tape(f);
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(f.Forward(0, fixture.x));
+  }
+}
+BENCHMARK(BM_FGEvalDouble)->Arg(6)->Arg(10)->Arg(15)->Arg(20);
+
+// A solve stopped after one Ipopt iteration, i.e. the setup, the taping and
+// the sparsity patterns plus one iteration.
+static void BM_IpoptIteration(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  MPC mpc;
+  mpc.N = st.range(0);
+  mpc.verbose = false;
+  mpc.warm_start = false;
+  mpc.ipopt_options = "Integer max_iter 1\n";
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(mpc.Solve(f.state, f.coeffs, latency, f.telemetry.steering_angle,
+                                       f.telemetry.throttle));
+  }
+}
+BENCHMARK(BM_IpoptIteration)->Arg(6)->Arg(10)->Arg(15)->Arg(20);
+
+static void BM_SolveCold(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  MPC mpc;
+  mpc.N = st.range(0);
+  mpc.verbose = false;
+  mpc.warm_start = false;
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(mpc.Solve(f.state, f.coeffs, latency, f.telemetry.steering_angle,
+                                       f.telemetry.throttle));
+  }
+}
+BENCHMARK(BM_SolveCold)->Arg(6)->Arg(10)->Arg(15)->Arg(20)->Unit(benchmark::kMillisecond);
+
+static void BM_SolveWarm(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  MPC mpc;
+  mpc.N = st.range(0);
+  mpc.verbose = false;
+  mpc.warm_start = true;
+  mpc.Solve(f.state, f.coeffs, latency, f.telemetry.steering_angle, f.telemetry.throttle);
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    benchmark::DoNotOptimize(mpc.Solve(f.state, f.coeffs, latency, f.telemetry.steering_angle,
+                                       f.telemetry.throttle));
+  }
+}
+BENCHMARK(BM_SolveWarm)->Arg(6)->Arg(10)->Arg(15)->Arg(20)->Unit(benchmark::kMillisecond);
+
+// The steer reply for a plan of N states, built with json.hpp as main.cpp
+// used to.
+static void BM_SerializeReply(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  size_t N = st.range(0);
+  vector<double> pred_info(2 + 2 * N);
+  for (size_t i=0; i<pred_info.size(); i++) { pred_info[i] = 0.1 * i + 1e-3; }
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    json msgJson;
+    msgJson["steering_angle"] = pred_info[0] / (25 * M_PI / 180);
+    msgJson["throttle"] = pred_info[1];
+    vector<double> mpc_x_vals;
+    vector<double> mpc_y_vals;
+    for (size_t t=2; t<pred_info.size(); t+=2)
+    {
+      mpc_x_vals.push_back(pred_info[t]);
+      mpc_y_vals.push_back(pred_info[t+1]);
+    }
+    msgJson["mpc_x"] = mpc_x_vals;
+    msgJson["mpc_y"] = mpc_y_vals;
+    msgJson["next_x"] = vector<double>(f.xvals.data(), f.xvals.data() + f.xvals.size());
+    msgJson["next_y"] = vector<double>(f.yvals.data(), f.yvals.data() + f.yvals.size());
+    benchmark::DoNotOptimize("42[\"steer\"," + msgJson.dump() + "]");
+  }
+}
+BENCHMARK(BM_SerializeReply)->Arg(6)->Arg(10)->Arg(15)->Arg(20);
+
+// The same reply with the ReplyWriter of main.cpp.
+static void BM_ReplyWriter(benchmark::State &st)
+{
+  const Frame &f = TheFrame();
+  size_t N = st.range(0);
+  vector<double> pred_info(2 + 2 * N);
+  for (size_t i=0; i<pred_info.size(); i++) { pred_info[i] = 0.1 * i + 1e-3; }
+  ReplyWriter writer;
+  BenchPerf counters(st);
+  for (auto _ : st)
+  {
+    writer.Steer(pred_info[0] / (25 * M_PI / 180), pred_info[1],
+                 Series(pred_info.data() + 2, N, 2), Series(pred_info.data() + 3, N, 2),
+                 Series(f.xvals.data(), f.xvals.size()), Series(f.yvals.data(), f.yvals.size()));
+    benchmark::DoNotOptimize(writer.Data());
+  }
+}
+BENCHMARK(BM_ReplyWriter)->Arg(6)->Arg(10)->Arg(15)->Arg(20);
+
+int main(int argc, char **argv)
+{
+  for (int i=1; i<argc; i++)
+  {
+    if (strcmp(argv[i], "--perf") != 0) { continue; }
+    perf = EnablePerfStages();
+    if (!perf) { fprintf(stderr, "perf_event_open is not available\n"); }
+    for (int k=i; k+1<argc; k++) { argv[k] = argv[k + 1]; }
+    argc--;
+    i--;
+  }
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include "cmaes.h"
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include "Eigen-3.3/Eigen/Eigenvalues"
+
+CMAES::CMAES(const Eigen::VectorXd &mean, double sigma, size_t lambda, unsigned seed)
+  : n(mean.size()), mean(mean), sigma(sigma), rng(seed)
+{
+  this->lambda = lambda > 0 ? lambda : 4 + (size_t)(3 * log((double)n));
+  mu = this->lambda / 2;
+  // Recombination weights of the mu best points.
+  weights.resize(mu);
+  for (size_t i=0; i<mu; i++) { weights[i] = log(mu + 0.5) - log(i + 1.0); }
+  weights /= weights.sum();
+  mueff = 1 / weights.squaredNorm();
+  // Learning rates of the step size and the covariance.
+  cc = (4 + mueff / n) / (n + 4 + 2 * mueff / n);
+  cs = (mueff + 2) / (n + mueff + 5);
+  c1 = 2 / ((n + 1.3) * (n + 1.3) + mueff);
+  cmu = min(1 - c1, 2 * (mueff - 2 + 1 / mueff) / ((n + 2) * (n + 2) + mueff));
+  damps = 1 + 2 * max(0.0, sqrt((mueff - 1) / (n + 1)) - 1) + cs;
+  chi_n = sqrt((double)n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+  pc = Eigen::VectorXd::Zero(n);
+  ps = Eigen::VectorXd::Zero(n);
+  C = Eigen::MatrixXd::Identity(n, n);
+  B = Eigen::MatrixXd::Identity(n, n);
+  D = Eigen::VectorXd::Ones(n);
+  generation = 0;
+  best = mean;
+  best_score = std::numeric_limits<double>::infinity();
+}
+
+const vector<Eigen::VectorXd> &CMAES::Ask()
+{
+  std::normal_distribution<double> normal(0.0, 1.0);
+  population.resize(lambda);
+  for (size_t k=0; k<lambda; k++)
+  {
+    Eigen::VectorXd z(n);
+    for (size_t i=0; i<n; i++) { z[i] = normal(rng); }
+    population[k] = mean + sigma * (B * D.asDiagonal() * z);
+  }
+  return population;
+}
+
+void CMAES::Tell(const vector<double> &scores)
+{
+  vector<size_t> order(lambda);
+  for (size_t k=0; k<lambda; k++) { order[k] = k; }
+  sort(order.begin(), order.end(),
+       [&scores](size_t i, size_t k) { return scores[i] < scores[k]; });
+  if (scores[order[0]] < best_score)
+  {
+    best_score = scores[order[0]];
+    best = population[order[0]];
+  }
+
+  Eigen::VectorXd old_mean = mean;
+  mean = Eigen::VectorXd::Zero(n);
+  for (size_t i=0; i<mu; i++) { mean += weights[i] * population[order[i]]; }
+  Eigen::VectorXd y_w = (mean - old_mean) / sigma;
+
+  // Evolution paths.
+  Eigen::VectorXd inv_sqrt_C_y = B * D.cwiseInverse().asDiagonal() * B.transpose() * y_w;
+  ps = (1 - cs) * ps + sqrt(cs * (2 - cs) * mueff) * inv_sqrt_C_y;
+  generation++;
+  double ps_norm = ps.norm() / sqrt(1 - pow(1 - cs, 2.0 * generation));
+  bool hsig = ps_norm / chi_n < 1.4 + 2.0 / (n + 1);
+  pc = (1 - cc) * pc + (hsig ? sqrt(cc * (2 - cc) * mueff) : 0.0) * y_w;
+
+  // Covariance: rank-one and rank-mu updates.
+  Eigen::MatrixXd rank_mu = Eigen::MatrixXd::Zero(n, n);
+  for (size_t i=0; i<mu; i++)
+  {
+    Eigen::VectorXd y = (population[order[i]] - old_mean) / sigma;
+    rank_mu += weights[i] * y * y.transpose();
+  }
+  C = (1 - c1 - cmu) * C
+    + c1 * (pc * pc.transpose() + (hsig ? 0.0 : cc * (2 - cc)) * C)
+    + cmu * rank_mu;
+  C = 0.5 * (C + C.transpose());
+
+  // Step size.
+  sigma *= exp(cs / damps * (ps.norm() / chi_n - 1));
+
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(C);
+  B = eigen.eigenvectors();
+  D = eigen.eigenvalues().cwiseMax(1e-20).cwiseSqrt();
+}
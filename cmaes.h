@@ -0,0 +1,60 @@
+#ifndef CMAES_H
+#define CMAES_H
+
+#include <random>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+
+using namespace std;
+
+// Covariance matrix adaptation evolution strategy, (mu/mu_w, lambda)-CMA-ES
+// with rank-one and rank-mu updates as in Hansen, "The CMA Evolution
+// Strategy: A Tutorial". It minimizes a function given only its values,
+// which suits noisy closed-loop scores.
+class CMAES {
+public:
+  // Start the search at `mean` with step size `sigma`. A `lambda` of zero
+  // picks the default population size 4 + 3 ln(n).
+  CMAES(const Eigen::VectorXd &mean, double sigma, size_t lambda = 0,
+        unsigned seed = 1);
+
+  // Sample the next population.
+  const vector<Eigen::VectorXd> &Ask();
+
+  // Update the distribution from the scores of the population of the last
+  // call to Ask, lower is better.
+  void Tell(const vector<double> &scores);
+
+  const Eigen::VectorXd &Mean() const { return mean; }
+  double Sigma() const { return sigma; }
+  size_t Lambda() const { return lambda; }
+
+  // Best point seen so far and its score.
+  const Eigen::VectorXd &Best() const { return best; }
+  double BestScore() const { return best_score; }
+
+private:
+  size_t n;
+  size_t lambda;
+  size_t mu;
+  Eigen::VectorXd weights;
+  double mueff;
+  double cc, cs, c1, cmu, damps, chi_n;
+
+  Eigen::VectorXd mean;
+  double sigma;
+  Eigen::VectorXd pc;
+  Eigen::VectorXd ps;
+  Eigen::MatrixXd C;
+  // C = B diag(D^2) B'
+  Eigen::MatrixXd B;
+  Eigen::VectorXd D;
+  size_t generation;
+
+  vector<Eigen::VectorXd> population;
+  Eigen::VectorXd best;
+  double best_score;
+  std::mt19937 rng;
+};
+
+#endif /* CMAES_H */
@@ -0,0 +1,278 @@
+#include "control_session.h"
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include "cppad_threads.h"
+#include "logger.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+namespace {
+
+// For converting back and forth between radians and degrees.
+constexpr double pi() { return M_PI; }
+double deg2rad(double x) { return x * pi() / 180; }
+
+}  // namespace
+
+ControlSession::ControlSession(Controller &controller, LoopLatency &loop_latency,
+                               TelemetryLogWriter &recorder)
+  : controller(controller), loop_latency(loop_latency), recorder(recorder), N(10),
+    sim_time_pre(NAN), processing_pre(0), generation(0), stopping(false)
+{
+  speculation.pending = false;
+  speculation.ready = false;
+}
+
+ControlSession::~ControlSession()
+{
+  if (solver.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    solver.join();
+  }
+}
+
+void ControlSession::Reset()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  time_pre = std::chrono::time_point<std::chrono::system_clock>();
+  sim_time_pre = NAN;
+  processing_pre = 0;
+  generation++;
+  speculation.pending = false;
+  speculation.ready = false;
+}
+
+void ControlSession::Speculate(const SpeculationTolerance &tolerance)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  this->tolerance = tolerance;
+  if (!solver.joinable())
+  {
+    // From now on the solver thread records CppAD tapes while the thread
+    // of a frame does.
+    SetupCppADThreads(1);
+    SetCppADParallel(true);
+    solver = std::thread(&ControlSession::SolveSpeculation, this);
+  }
+}
+
+void ControlSession::SolveSpeculation()
+{
+  SetTraceThreadName("speculation");
+  SetCppADThread(1);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    wake.wait(lock, [this] { return speculation.pending || stopping; });
+    if (stopping) { return; }
+    speculation.pending = false;
+    uint64_t started = generation;
+    Telemetry telemetry = speculation.telemetry;
+    double elapsed = speculation.elapsed;
+    // Solve a copy of the controller without the lock, so that a frame
+    // arriving meanwhile is solved at once instead of after the guess.
+    speculative = controller;
+    // Stop at the next Ipopt iteration once the guess is of no use, so that
+    // the solver thread is free for the next one and no longer competes
+    // with the solve of the frame.
+    speculative.mpc.SetCancelled([this, started] { return generation.load() != started; });
+    lock.unlock();
+    ControlOutput out;
+    {
+      TraceSpan span("speculative_solve");
+      out = speculative.Step(telemetry, elapsed);
+    }
+    speculative.mpc.SetCancelled(std::function<bool()>());
+    lock.lock();
+    // A frame arrived during the solve, the guess is of no use.
+    if (generation != started) { continue; }
+    speculation.out = out;
+    speculation.ready = true;
+  }
+}
+
+// Whether the telemetry is close enough to the prediction of the
+// speculative solve for the solve to answer it.
+bool ControlSession::Predicted(const Telemetry &telemetry, double elapsed) const
+{
+  const Telemetry &p = speculation.telemetry;
+  return p.ptsx == telemetry.ptsx && p.ptsy == telemetry.ptsy &&
+         hypot(telemetry.x - p.x, telemetry.y - p.y) <= tolerance.position &&
+         fabs(remainder(telemetry.psi - p.psi, 2 * M_PI)) <= tolerance.psi &&
+         fabs(telemetry.speed - p.speed) <= tolerance.speed &&
+         fabs(telemetry.steering_angle - p.steering_angle) <= tolerance.actuators &&
+         fabs(telemetry.throttle - p.throttle) <= tolerance.actuators &&
+         fabs(elapsed - speculation.elapsed) <= tolerance.latency;
+}
+
+bool ControlSession::Handle(const Telemetry &telemetry, double sim_time,
+                            std::chrono::steady_clock::time_point received,
+                            int64_t received_ns, ReplySink &sink)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  // A speculation the solver thread has not finished is too late now.
+  generation++;
+  speculation.pending = false;
+  auto parsed = std::chrono::steady_clock::now();
+  loop_latency.Record(LoopLatency::PARSE,
+                      std::chrono::duration<double>(parsed - received).count());
+  if (TraceEnabled()) { TraceComplete("parse", TraceTime(received), TraceTime(parsed)); }
+
+  std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - time_pre;
+  time_pre = std::chrono::system_clock::now();
+  double elapsed = elapsed_seconds.count();
+  // A simulator running faster than real time sends its clock and
+  // simulates the actuation delay itself.
+  bool sim_clock = !isnan(sim_time);
+  if (sim_clock)
+  {
+    // A frame that is not newer than the previous one has been
+    // answered already.
+    if (sim_time <= sim_time_pre)
+    {
+      // The speculation was predicted for the frame after the previous
+      // one, so it goes with this frame rather than answer a later one.
+      speculation.ready = false;
+      Count(STALE_FRAMES);
+      return false;
+    }
+    elapsed = isnan(sim_time_pre) ? 0 : sim_time - sim_time_pre;
+    sim_time_pre = sim_time;
+  }
+  if (recorder.IsOpen())
+  {
+    recorder.Append(TelemetryRecord(telemetry, received_ns, sim_time));
+  }
+
+  // Fit the reference line, handle the latency and solve the MPC,
+  // see controller.cpp. The speculative solve may have done it already.
+  ControlOutput out;
+  bool hit = false;
+  if (speculation.ready)
+  {
+    speculation.ready = false;
+    hit = Predicted(telemetry, elapsed);
+    Count(hit ? SPECULATIVE_HITS : SPECULATIVE_MISSES);
+    if (hit)
+    {
+      // Continue from the copy as if this thread had solved the cycle: its
+      // plans, latency estimate, horizon selection and last solve. Weights
+      // set meanwhile apply from the next cycle, as they would have.
+      CostWeights weights = controller.mpc.Weights();
+      bool verbose = controller.verbose;
+      controller = speculative;
+      controller.mpc.SetWeights(weights);
+      controller.verbose = verbose;
+      out = speculation.out;
+      out.transform_time = 0;
+      out.fit_time = 0;
+      out.solve_time = 0;
+    }
+    else
+    {
+      // The plan of the copy is for about this cycle, the closest start,
+      // and only needs a new start.
+      controller.mpc.CopyWarmStart(speculative.mpc);
+      controller.mpc.HoldWarmStart(speculation.out.latency);
+    }
+  }
+  if (!hit) { out = controller.Step(telemetry, elapsed); }
+  auto solved = std::chrono::steady_clock::now();
+  loop_latency.Record(LoopLatency::TRANSFORM, out.transform_time);
+  loop_latency.Record(LoopLatency::FIT, out.fit_time);
+  loop_latency.Record(LoopLatency::SOLVE, out.solve_time);
+  Count(SOLVES);
+  if (!out.solve_ok)
+  {
+    Count(SOLVE_FAILURES);
+    static LogRate failure_rate(1.0);
+    LogRated(failure_rate, LOG_WARN, "MPC solve did not converge, {} iterations",
+             out.stats.iterations);
+  }
+  SetGauge(LATENCY_ESTIMATE, out.latency);
+  SetGauge(HORIZON_STATES, controller.mpc.Config(controller.mpc.Selected()).N);
+  Count(IPOPT_ITERATIONS, out.stats.iterations);
+  Count(IPOPT_RESTORATIONS, out.stats.restorations);
+  Count(IPOPT_EVAL_NANOSECONDS, out.stats.EvalTime() * 1e9);
+  Count(IPOPT_INTERNAL_NANOSECONDS, max(out.stats.IpoptTime(), 0.0) * 1e9);
+  Count(IPOPT_LINEAR_SOLVER_NANOSECONDS, out.stats.linear_solver_time * 1e9);
+  Count(IPOPT_TAPE_NANOSECONDS, out.stats.tape_time * 1e9);
+  SetGauge(IPOPT_LAST_ITERATIONS, out.stats.iterations);
+  SetGauge(CONSTRAINT_VIOLATION, out.stats.constraint_violation);
+  // Recall the first two components contain actuation values [steer_value, throttle_value],
+  // followed with N
+  double steer_value    = out.pred_info[0];
+  double throttle_value = out.pred_info[1];
+
+  // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
+  // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
+  double steering = steer_value/deg2rad(25);
+  Log(LOG_DEBUG, "Steering Angle: {}", steer_value);
+
+  {
+    PerfScope perf(PERF_JSON_DUMP);
+    sink.Format(steering, throttle_value, out, N);
+  }
+  auto serialized = std::chrono::steady_clock::now();
+  loop_latency.Record(LoopLatency::SERIALIZE,
+                      std::chrono::duration<double>(serialized - solved).count());
+  // Latency
+  // The purpose is to mimic real driving conditions where
+  // the car does actuate the commands instantly.
+  //
+  // Feel free to play around with this value but should be to drive
+  // around the track with 100ms latency.
+  //
+  // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
+  // SUBMITTING.
+  if (!sim_clock)
+  {
+    lock.unlock();
+    this_thread::sleep_for(chrono::milliseconds(100));
+    lock.lock();
+  }
+  if (recorder.IsOpen())
+  {
+    recorder.Append(SteerRecord(steering, throttle_value, recorder.Now()));
+  }
+  auto sending = std::chrono::steady_clock::now();
+  sink.Send();
+  Count(MESSAGES_SENT);
+  auto sent = std::chrono::steady_clock::now();
+  loop_latency.Record(LoopLatency::SEND,
+                      std::chrono::duration<double>(sent - sending).count());
+  // The actuation delay is not part of the processing time.
+  double processing = std::chrono::duration<double>(
+    (sent - received) - (sending - serialized)).count();
+  loop_latency.RecordCycle(processing);
+  if (TraceEnabled())
+  {
+    TraceComplete("serialize", TraceTime(solved), TraceTime(serialized));
+    TraceComplete("actuation_delay", TraceTime(serialized), TraceTime(sending));
+    TraceComplete("send", TraceTime(sending), TraceTime(sent));
+    TraceComplete("cycle", TraceTime(received), TraceTime(sent));
+  }
+  // The time between two frames is the processing of the cycle between
+  // them plus about the same delay of the simulator as before. Longer gaps
+  // than the latency cap of the controller are not steady driving.
+  double next_elapsed = max(elapsed - processing_pre, 0.0) + processing;
+  processing_pre = processing;
+  if (solver.joinable() && next_elapsed <= 0.25)
+  {
+    // Replaces a speculation still solving for another cycle.
+    generation++;
+    speculation.elapsed = next_elapsed;
+    speculation.telemetry = PredictTelemetry(telemetry, next_elapsed, steer_value,
+                                             throttle_value);
+    speculation.pending = true;
+    wake.notify_one();
+  }
+  return true;
+}
@@ -0,0 +1,129 @@
+#ifndef CONTROL_SESSION_H
+#define CONTROL_SESSION_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "controller.h"
+#include "latency_histogram.h"
+#include "telemetry_log.h"
+
+using namespace std;
+
+// Where a session sends its replies: a websocket connection of main.cpp or
+// the shared memory ring of shm_transport.h.
+class ReplySink {
+public:
+  virtual ~ReplySink() {}
+
+  // Write the reply to a cycle, before the actuation delay. `steering` is
+  // normalized to [-1, 1]. `N` is the number of zeros the simulator has
+  // always been sent before the planned points.
+  virtual void Format(double steering, double throttle, const ControlOutput &out,
+                      size_t N) = 0;
+
+  // Send the reply written by Format.
+  virtual void Send() = 0;
+};
+
+// How far the telemetry may be from the prediction of a speculative solve
+// for that solve to answer it, see ControlSession::Speculate.
+struct SpeculationTolerance {
+  // Position in m, orientation in radians and speed in mph.
+  double position;
+  double psi;
+  double speed;
+  // Reported actuators, the steering angle in radians.
+  double actuators;
+  // Time since the previous telemetry in seconds, which the solve takes
+  // as the latency.
+  double latency;
+
+  SpeculationTolerance()
+    : position(0.05), psi(0.005), speed(0.2), actuators(1e-3), latency(0.005) {}
+};
+
+// The control loop of main.cpp without the transport. Runs the controller
+// on each decoded telemetry frame, estimates the latency from the clocks,
+// keeps the latencies, metrics, trace and recording of the cycles, and
+// hands the reply to the transport the frame came from.
+class ControlSession {
+public:
+  ControlSession(Controller &controller, LoopLatency &loop_latency,
+                 TelemetryLogWriter &recorder);
+  virtual ~ControlSession();
+
+  // Run one cycle on a frame that arrived at `received`, `received_ns` on
+  // the clock of the recorder. `sim_time` is the clock of the simulator,
+  // NaN if it has none. Returns false if the frame is not newer than the
+  // previous one and was not answered.
+  bool Handle(const Telemetry &telemetry, double sim_time,
+              std::chrono::steady_clock::time_point received, int64_t received_ns,
+              ReplySink &sink);
+
+  // Start over with a new client, whose clock starts again.
+  void Reset();
+
+  // Between a reply and the next telemetry the controller is idle. From now
+  // on, right after each reply a solver thread solves for the telemetry
+  // predicted for the next cycle, see PredictTelemetry, on a copy of the
+  // controller and without the lock. If the telemetry then arrives within
+  // `tolerance` of the prediction, that solve answers it at once and the
+  // controller carries on from the copy.
+  // Otherwise the cycle is solved as usual, warm started from the
+  // speculative plan if it is done, and a frame arriving during the
+  // speculative solve does not wait for it. Two solves may then run at
+  // once, so call this before any other thread solves, and Ipopt needs a
+  // thread-safe linear solver, see mpc_tune.cpp.
+  void Speculate(const SpeculationTolerance &tolerance);
+
+  // Held during a cycle, except during the actuation delay. Hold it to
+  // change the controller from another thread, e.g. its weights. Not held
+  // during a speculative solve.
+  std::mutex mutex;
+
+private:
+  Controller &controller;
+  LoopLatency &loop_latency;
+  TelemetryLogWriter &recorder;
+  // steps
+  int N;
+  // Set a variable to save the previous time stamp.
+  // This is used to estimate the latency
+  std::chrono::time_point<std::chrono::system_clock> time_pre;
+  // Simulated time of the previous telemetry, when the simulator sends its
+  // clock as the headless simulator mpc_sim does.
+  double sim_time_pre;
+  // Processing time of the previous cycle in seconds.
+  double processing_pre;
+
+  // The speculative solve, guarded by `mutex`. `pending` while it waits
+  // for the solver thread, `ready` once solved and still current.
+  struct Speculation {
+    bool pending;
+    bool ready;
+    Telemetry telemetry;
+    double elapsed;
+    ControlOutput out;
+  };
+  Speculation speculation;
+  // The copy of the controller the solver thread solves. Only the solver
+  // thread uses it until the speculation is ready, then only Handle.
+  Controller speculative;
+  // Counts the frames, resets and speculations. A speculation started
+  // before the last one is stopped and discarded. Changed under `mutex`,
+  // read without it by the speculative solve.
+  std::atomic<uint64_t> generation;
+  SpeculationTolerance tolerance;
+  std::thread solver;
+  std::condition_variable wake;
+  bool stopping;
+
+  void SolveSpeculation();
+  bool Predicted(const Telemetry &telemetry, double elapsed) const;
+};
+
+#endif /* CONTROL_SESSION_H */
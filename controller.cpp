@@ -0,0 +1,160 @@
+#include "controller.h"
+#include <math.h>
+#include <chrono>
+#include "Eigen-3.3/Eigen/QR"
+#include "logger.h"
+#include "perf_counters.h"
+#include "trace.h"
+
+string hasData(string s)
+{
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.rfind("}]");
+  if (found_null != string::npos) {
+    return "";
+  } else if (b1 != string::npos && b2 != string::npos) {
+    return s.substr(b1, b2 - b1 + 2);
+  }
+  return "";
+}
+
+// Evaluate a polynomial.
+double polyeval(Eigen::VectorXd coeffs, double x)
+{
+  double result = 0.0;
+  for (int i = 0; i < coeffs.size(); i++)
+  {
+    result += coeffs[i] * pow(x, i);
+  }
+  return result;
+}
+
+// Fit a polynomial.
+// Adapted from
+// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
+Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals, int order)
+{
+  assert(xvals.size() == yvals.size());
+  assert(order >= 1 && order <= xvals.size() - 1);
+  PerfScope perf(PERF_POLYFIT);
+  Eigen::MatrixXd A(xvals.size(), order + 1);
+  for (int i = 0; i < xvals.size(); i++)
+  {
+    A(i, 0) = 1.0;
+  }
+  for (int j = 0; j < xvals.size(); j++)
+  {
+    for (int i = 0; i < order; i++) {
+      A(j, i + 1) = A(j, i) * xvals(j);
+    }
+  }
+  auto Q = A.householderQr();
+  auto result = Q.solve(yvals);
+  return result;
+}
+
+void globalToLocal(vector<double> &ptsx, vector<double> &ptsy, double px, double py,
+                   double psi, Eigen::VectorXd &xvals, Eigen::VectorXd &yvals)
+{
+  for (size_t i=0; i<ptsx.size(); i++)
+  {
+    double dx = ptsx[i] - px;
+    double dy = ptsy[i] - py;
+    xvals[i] = dx * cos(-psi) - dy * sin(-psi);
+    yvals[i] = dx * sin(-psi) + dy * cos(-psi);
+  }
+}
+
+Telemetry PredictTelemetry(const Telemetry &telemetry, double latency, double delta, double a)
+{
+  Telemetry next = telemetry;
+  // Convert speed from mph to m/s
+  double v = telemetry.speed * 0.44704;
+  const size_t steps = 10;
+  double h = latency / steps;
+  for (size_t i=0; i<steps; i++)
+  {
+    next.x += v * cos(next.psi) * h;
+    next.y += v * sin(next.psi) * h;
+    next.psi -= v * telemetry.steering_angle / Lf * h;
+    v += telemetry.throttle * h;
+  }
+  next.speed = v / 0.44704;
+  next.steering_angle = delta;
+  next.throttle = a;
+  return next;
+}
+
+Controller::Controller()
+{
+  verbose = true;
+  latency_init = true;
+}
+
+Controller::~Controller() {}
+
+ControlOutput Controller::Step(Telemetry telemetry, double elapsed)
+{
+  ControlOutput out;
+  // Convert speed from mph to m/s
+  double v = telemetry.speed * 0.44704;
+  // Obtain current actuator values [delta, a] = ["steering_angle","throttle"],
+  // which will be used in calibration of latency
+  double delta0 = telemetry.steering_angle;
+  double a0 = telemetry.throttle;
+  if (verbose) { Log(LOG_INFO, "real latency: {}", elapsed); }
+
+  // Transform from global map system to local vehicle system so that the life is easier.
+  auto start = std::chrono::steady_clock::now();
+  size_t n_pts = telemetry.ptsx.size();
+  out.xvals.resize(n_pts);
+  out.yvals.resize(n_pts);
+  globalToLocal(telemetry.ptsx, telemetry.ptsy, telemetry.x, telemetry.y, telemetry.psi,
+                out.xvals, out.yvals);
+  auto transformed = std::chrono::steady_clock::now();
+  // Fit for the reference line
+  Eigen::VectorXd coeffs = polyfit(out.xvals, out.yvals, 3);
+  auto fitted = std::chrono::steady_clock::now();
+  // Calculate the cross track error in vehicle's coordinate system.
+  double cte = polyeval(coeffs, 0);
+  // Calculate the epsi in vehicle's coordinate system
+  double epsi = -atan(coeffs[1]);
+  // Handle latency
+  // The latency is folded into the MPC horizon: its first steps
+  // integrate the model over the latency with the actuators already
+  // committed to the vehicle, and the plan starts at actuation time.
+  if (!latency_init)
+  {
+    out.latency = elapsed;
+  }
+  else
+  {
+    if (verbose) { Log(LOG_INFO, "Latency initialization!"); }
+    out.latency = 0.15;
+    latency_init = false;
+  }
+  if (out.latency >= 0.25) { out.latency = 0.25; }
+  if (verbose) { Log(LOG_INFO, "latency used: {}", out.latency); }
+
+  // Recall in the local vehicle system, we have px = py = psi = 0, v=v
+  Eigen::VectorXd state = mpc.solvers[0].InitialState(v, cte, epsi, delta0);
+  for (size_t i=0; i<mpc.solvers.size(); i++) { mpc.solvers[i].verbose = verbose; }
+  // Use MPC to obtain a decent steering angle and throttle.
+  // Both are in between [-1, 1].
+  auto solving = std::chrono::steady_clock::now();
+  out.pred_info = mpc.Solve(v, state, coeffs, out.latency, delta0, a0);
+  out.solve_ok = mpc.LastSolveOk();
+  out.stats = mpc.LastSolveStats();
+  auto solved = std::chrono::steady_clock::now();
+  out.transform_time = std::chrono::duration<double>(transformed - start).count();
+  out.fit_time = std::chrono::duration<double>(fitted - transformed).count();
+  out.solve_time = std::chrono::duration<double>(solved - solving).count();
+  if (TraceEnabled())
+  {
+    TraceComplete("transform", TraceTime(start), TraceTime(transformed));
+    TraceComplete("fit", TraceTime(transformed), TraceTime(fitted));
+    TraceComplete("solve", TraceTime(solving), TraceTime(solved), mpc.Config(mpc.Selected()).N);
+  }
+  return out;
+}
@@ -0,0 +1,91 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "adaptive_mpc.h"
+
+using namespace std;
+
+// Checks if the SocketIO event has JSON data.
+// If there is data the JSON object in string format will be returned,
+// else the empty string "" will be returned.
+string hasData(string s);
+
+// Evaluate a polynomial.
+double polyeval(Eigen::VectorXd coeffs, double x);
+
+// Fit a polynomial.
+Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals, int order);
+
+// Transfer from map/global coordinate system to vehicle/local coordinate system.
+// In the vehicle/local system, the position px = py = 0, and orientation psi = 0,
+// which can simplify future calculations.
+void globalToLocal(vector<double> &ptsx, vector<double> &ptsy, double px, double py,
+                   double psi, Eigen::VectorXd &xvals, Eigen::VectorXd &yvals);
+
+// One telemetry message of the simulator.
+struct Telemetry {
+  // Waypoints of the reference line in map coordinates.
+  vector<double> ptsx;
+  vector<double> ptsy;
+  // Position and orientation in map coordinates.
+  double x;
+  double y;
+  double psi;
+  // Speed in mph.
+  double speed;
+  // Current actuators, the steering angle in radians.
+  double steering_angle;
+  double throttle;
+};
+
+// The telemetry `latency` seconds later, as the MPC models the delay: the
+// car drives on the actuators of `telemetry` with the kinematic model, and
+// then reports the actuators `delta` and `a` it was sent in reply. The
+// waypoints stay the same.
+Telemetry PredictTelemetry(const Telemetry &telemetry, double latency, double delta, double a);
+
+// Result of one control cycle.
+struct ControlOutput {
+  // Actuators [delta, a] followed by the predicted positions, see MPC::Solve.
+  vector<double> pred_info;
+  // Waypoints in the vehicle coordinate system.
+  Eigen::VectorXd xvals;
+  Eigen::VectorXd yvals;
+  // Latency the actuators were planned for, in seconds.
+  double latency;
+  // Whether the solver converged.
+  bool solve_ok;
+  // Time spent in the stages of the cycle in seconds: the transform of the
+  // waypoints, the polynomial fit and the MPC solve.
+  double transform_time;
+  double fit_time;
+  double solve_time;
+  // Iterations, evaluation times and final infeasibility of the solve.
+  SolveStats stats;
+};
+
+// The control loop of main.cpp without the transport: fits the reference
+// line to the waypoints, estimates the latency and solves the MPC. It is
+// shared by the websocket server and the offline tools.
+class Controller {
+public:
+  Controller();
+  virtual ~Controller();
+
+  // Run one cycle. `elapsed` is the time since the previous telemetry in
+  // seconds, which is used as the latency estimate.
+  ControlOutput Step(Telemetry telemetry, double elapsed);
+
+  // The horizon is picked every cycle from the current speed.
+  AdaptiveMPC mpc;
+
+  // Print the latencies and the cost of every cycle.
+  bool verbose;
+
+private:
+  bool latency_init;
+};
+
+#endif /* CONTROLLER_H */
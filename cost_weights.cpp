@@ -0,0 +1,100 @@
+#include "cost_weights.h"
+#include <fstream>
+#include <sstream>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Name and member of each weight.
+struct WeightField {
+  const char *name;
+  double CostWeights::*value;
+};
+
+const WeightField fields[] = {
+  {"cte", &CostWeights::cte},
+  {"epsi", &CostWeights::epsi},
+  {"v", &CostWeights::v},
+  {"delta", &CostWeights::delta},
+  {"a", &CostWeights::a},
+  {"ddelta", &CostWeights::ddelta},
+  {"da", &CostWeights::da},
+  {"dcte", &CostWeights::dcte},
+  {"depsi", &CostWeights::depsi},
+  {"curvature", &CostWeights::curvature},
+  {"ref_v", &CostWeights::ref_v},
+};
+
+const WeightField *findField(const string &name)
+{
+  for (const WeightField &field : fields)
+  {
+    if (name == field.name) { return &field; }
+  }
+  return NULL;
+}
+
+}  // namespace
+
+string WeightsToJson(const CostWeights &weights)
+{
+  json j = json::object();
+  for (const WeightField &field : fields)
+  {
+    j[field.name] = weights.*field.value;
+  }
+  return j.dump();
+}
+
+bool WeightsFromJson(const string &text, CostWeights &weights, string &error)
+{
+  json j;
+  try
+  {
+    j = json::parse(text);
+  }
+  catch (const std::exception &e)
+  {
+    error = e.what();
+    return false;
+  }
+  if (!j.is_object())
+  {
+    error = "expected a JSON object";
+    return false;
+  }
+  // Validate everything before changing anything.
+  CostWeights updated = weights;
+  for (json::iterator it = j.begin(); it != j.end(); ++it)
+  {
+    const WeightField *field = findField(it.key());
+    if (field == NULL)
+    {
+      error = "unknown weight \"" + it.key() + "\"";
+      return false;
+    }
+    if (!it.value().is_number())
+    {
+      error = "weight \"" + it.key() + "\" is not a number";
+      return false;
+    }
+    updated.*field->value = it.value().get<double>();
+  }
+  weights = updated;
+  return true;
+}
+
+bool LoadWeights(const string &path, CostWeights &weights, string &error)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    error = "cannot open " + path;
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return WeightsFromJson(buffer.str(), weights, error);
+}
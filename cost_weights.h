@@ -0,0 +1,48 @@
+#ifndef COST_WEIGHTS_H
+#define COST_WEIGHTS_H
+
+#include <string>
+
+using namespace std;
+
+// Weights of the terms of the MPC cost function and the reference speed.
+// They are plain values read by FG_eval every time the cost is taped, so
+// they can be changed between two solves without rebuilding anything.
+struct CostWeights {
+  // Reference state: cross track error, orientation error and speed.
+  double cte;
+  double epsi;
+  double v;
+  // Use of the actuators.
+  double delta;
+  double a;
+  // Gap between sequential actuations.
+  double ddelta;
+  double da;
+  // Gap between sequential errors.
+  double dcte;
+  double depsi;
+  // Product of the curvature of the reference line and the speed.
+  double curvature;
+  // Reference speed in m/s, not mph.
+  double ref_v;
+
+  // The weights found by the experiments of the README.
+  CostWeights()
+    : cte(10), epsi(2), v(1), delta(1000), a(1), ddelta(200), da(1),
+      dcte(100), depsi(200), curvature(1150), ref_v(50) {}
+};
+
+// Serialize the weights as a JSON object keyed by the field names.
+string WeightsToJson(const CostWeights &weights);
+
+// Update `weights` from a JSON object. Only the keys present are changed,
+// so a partial object tunes a single term. On a parse error or an unknown
+// key `weights` is left untouched, `error` describes the problem and false
+// is returned.
+bool WeightsFromJson(const string &text, CostWeights &weights, string &error);
+
+// Same as WeightsFromJson with the content of the file at `path`.
+bool LoadWeights(const string &path, CostWeights &weights, string &error);
+
+#endif /* COST_WEIGHTS_H */
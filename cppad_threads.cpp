@@ -0,0 +1,31 @@
+#include "cppad_threads.h"
+#include <atomic>
+#include <cppad/cppad.hpp>
+
+namespace {
+
+// 0 is the main thread.
+thread_local size_t thread_number = 0;
+std::atomic<bool> in_parallel(false);
+
+bool InParallel() { return in_parallel; }
+size_t ThreadNumber() { return thread_number; }
+
+}  // namespace
+
+void SetupCppADThreads(size_t n_threads)
+{
+  CppAD::thread_alloc::parallel_setup(n_threads + 1, InParallel, ThreadNumber);
+  CppAD::thread_alloc::hold_memory(true);
+  CppAD::parallel_ad<double>();
+}
+
+void SetCppADThread(size_t number)
+{
+  thread_number = number;
+}
+
+void SetCppADParallel(bool parallel)
+{
+  in_parallel = parallel;
+}
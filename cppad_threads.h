@@ -0,0 +1,15 @@
+#ifndef CPPAD_THREADS_H
+#define CPPAD_THREADS_H
+
+#include <cstddef>
+
+// CppAD keeps its tapes in per thread memory, which has to be set up before
+// several threads record at the same time. Call SetupCppADThreads from the
+// main thread before starting the workers, give each worker its number
+// from 1 to n_threads with SetCppADThread, and mark the parallel section
+// with SetCppADParallel.
+void SetupCppADThreads(size_t n_threads);
+void SetCppADThread(size_t thread_number);
+void SetCppADParallel(bool in_parallel);
+
+#endif /* CPPAD_THREADS_H */
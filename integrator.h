@@ -0,0 +1,73 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <cstddef>
+
+// Integration schemes for the model over one interval of the horizon.
+// The actuators are held constant over the interval.
+enum Integrator {
+  // One explicit Euler step, the scheme of the classroom model.
+  EULER,
+  // Midpoint rule.
+  RK2,
+  // Classic fourth order Runge-Kutta.
+  RK4,
+  // `substeps` explicit Euler steps of length dt / substeps.
+  EULER_SUBSTEPS
+};
+
+// Integrate `f` over an interval of length `h` starting from `s` and store
+// the change of the state in `ds`, i.e. s(t + h) = s(t) + ds.
+// `f(s, sdot)` evaluates the time derivative of an `n`-element state and `T`
+// is either double or CppAD::AD<double>, so the same code serves the
+// predictor and the NLP constraints.
+template <size_t n, typename T, class Derivative>
+void IntegrateIncrement(Integrator method, size_t substeps, Derivative &f,
+                        const T *s, double h, T *ds)
+{
+  T k1[n], k2[n], k3[n], k4[n], tmp[n];
+  switch (method)
+  {
+    case RK2:
+      f(s, k1);
+      for (size_t i=0; i<n; i++) { tmp[i] = s[i] + 0.5 * h * k1[i]; }
+      f(tmp, k2);
+      for (size_t i=0; i<n; i++) { ds[i] = h * k2[i]; }
+      break;
+    case RK4:
+      f(s, k1);
+      for (size_t i=0; i<n; i++) { tmp[i] = s[i] + 0.5 * h * k1[i]; }
+      f(tmp, k2);
+      for (size_t i=0; i<n; i++) { tmp[i] = s[i] + 0.5 * h * k2[i]; }
+      f(tmp, k3);
+      for (size_t i=0; i<n; i++) { tmp[i] = s[i] + h * k3[i]; }
+      f(tmp, k4);
+      for (size_t i=0; i<n; i++)
+      {
+        ds[i] = h / 6 * (k1[i] + 2 * k2[i] + 2 * k3[i] + k4[i]);
+      }
+      break;
+    case EULER_SUBSTEPS:
+      if (substeps > 1)
+      {
+        double hs = h / substeps;
+        for (size_t i=0; i<n; i++) { tmp[i] = s[i]; }
+        for (size_t k=0; k<substeps; k++)
+        {
+          f(tmp, k1);
+          for (size_t i=0; i<n; i++) { tmp[i] = tmp[i] + hs * k1[i]; }
+        }
+        for (size_t i=0; i<n; i++) { ds[i] = tmp[i] - s[i]; }
+        break;
+      }
+      // A single sub-step is plain Euler.
+      // fall through
+    case EULER:
+    default:
+      f(s, k1);
+      for (size_t i=0; i<n; i++) { ds[i] = h * k1[i]; }
+      break;
+  }
+}
+
+#endif /* INTEGRATOR_H */
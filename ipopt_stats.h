@@ -0,0 +1,205 @@
+#ifndef IPOPT_STATS_H
+#define IPOPT_STATS_H
+
+#include <chrono>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <cppad/cppad.hpp>
+#include <cppad/ipopt/solve.hpp>
+#include <cppad/ipopt/solve_callback.hpp>
+#include <coin/IpIpoptApplication.hpp>
+#include <coin/IpIpoptData.hpp>
+#include <coin/IpoptConfig.h>
+#include "perf_counters.h"
+#include "solve_stats.h"
+#include "trace.h"
+
+using namespace std;
+
+// The NLP of CppAD::ipopt::solve, with the evaluations timed and the
+// iterations followed through Ipopt's intermediate callback, which also
+// stops the solve once `cancelled` returns true.
+template <class Dvector, class ADvector, class FG_eval>
+class StatsCallback : public CppAD::ipopt::solve_callback<Dvector, ADvector, FG_eval> {
+public:
+  typedef CppAD::ipopt::solve_callback<Dvector, ADvector, FG_eval> Base;
+  typedef Ipopt::Index Index;
+  typedef Ipopt::Number Number;
+
+  StatsCallback(size_t nx, size_t ng, const Dvector &xi, const Dvector &xl,
+                const Dvector &xu, const Dvector &gl, const Dvector &gu, FG_eval &fg_eval,
+                bool retape, bool sparse_forward, bool sparse_reverse,
+                CppAD::ipopt::solve_result<Dvector> &solution, SolveStats &stats,
+                const std::function<bool()> &cancelled)
+    : Base(1, nx, ng, xi, xl, xu, gl, gu, fg_eval, retape, sparse_forward, sparse_reverse,
+           solution),
+      stats(stats), cancelled(cancelled), restoration(false),
+      iteration_start(TraceEnabled() ? TraceNow() : -1) {}
+
+  virtual bool eval_f(Index n, const Number *x, bool new_x, Number &obj_value)
+  {
+    Timer timer(stats.eval_f_time, "eval_f");
+    return Base::eval_f(n, x, new_x, obj_value);
+  }
+
+  virtual bool eval_grad_f(Index n, const Number *x, bool new_x, Number *grad_f)
+  {
+    Timer timer(stats.eval_grad_f_time, "eval_grad_f");
+    return Base::eval_grad_f(n, x, new_x, grad_f);
+  }
+
+  virtual bool eval_g(Index n, const Number *x, bool new_x, Index m, Number *g)
+  {
+    Timer timer(stats.eval_g_time, "eval_g");
+    return Base::eval_g(n, x, new_x, m, g);
+  }
+
+  virtual bool eval_jac_g(Index n, const Number *x, bool new_x, Index m, Index nele_jac,
+                          Index *iRow, Index *jCol, Number *values)
+  {
+    Timer timer(stats.eval_jac_g_time, "eval_jac_g");
+    return Base::eval_jac_g(n, x, new_x, m, nele_jac, iRow, jCol, values);
+  }
+
+  virtual bool eval_h(Index n, const Number *x, bool new_x, Number obj_factor, Index m,
+                      const Number *lambda, bool new_lambda, Index nele_hess, Index *iRow,
+                      Index *jCol, Number *values)
+  {
+    Timer timer(stats.eval_h_time, "eval_h");
+    return Base::eval_h(n, x, new_x, obj_factor, m, lambda, new_lambda, nele_hess, iRow,
+                        jCol, values);
+  }
+
+  virtual bool intermediate_callback(Ipopt::AlgorithmMode mode, Index iter, Number obj_value,
+                                     Number inf_pr, Number inf_du, Number mu, Number d_norm,
+                                     Number regularization_size, Number alpha_du,
+                                     Number alpha_pr, Index ls_trials,
+                                     const Ipopt::IpoptData *ip_data,
+                                     Ipopt::IpoptCalculatedQuantities *ip_cq)
+  {
+    bool in_restoration = mode == Ipopt::RestorationPhaseMode;
+    if (in_restoration && !restoration) { stats.restorations++; }
+    restoration = in_restoration;
+    stats.iterations = iter;
+    stats.constraint_violation = inf_pr;
+    stats.dual_infeasibility = inf_du;
+    if (TraceEnabled())
+    {
+      int64_t now = TraceNow();
+      if (iteration_start >= 0)
+      {
+        TraceComplete(in_restoration ? "ipopt_restoration_iteration" : "ipopt_iteration",
+                      iteration_start, now, iter);
+      }
+      iteration_start = now;
+    }
+    // Ipopt then returns User_Requested_Stop.
+    return !(cancelled && cancelled());
+  }
+
+private:
+  // Add the lifetime of the timer to `total`, and trace it as `name`.
+  struct Timer {
+    double &total;
+    const char *name;
+    PerfScope perf;
+    std::chrono::steady_clock::time_point start;
+    Timer(double &total, const char *name)
+      : total(total), name(name), perf(PERF_NLP_EVAL), start(std::chrono::steady_clock::now()) {}
+    ~Timer()
+    {
+      auto end = std::chrono::steady_clock::now();
+      total += std::chrono::duration<double>(end - start).count();
+      if (TraceEnabled()) { TraceComplete(name, TraceTime(start), TraceTime(end)); }
+    }
+  };
+
+  SolveStats &stats;
+  const std::function<bool()> &cancelled;
+  bool restoration;
+  // Trace time of the previous intermediate callback, -1 when not tracing.
+  int64_t iteration_start;
+};
+
+// Same as CppAD::ipopt::solve, with the same options string, and also
+// fills `stats`. If `cancelled` is set, it is called at every iteration and
+// the solve stops with user_requested_stop once it returns true.
+template <class Dvector, class FG_eval>
+void SolveWithStats(const string &options, const Dvector &xi, const Dvector &xl,
+                    const Dvector &xu, const Dvector &gl, const Dvector &gu, FG_eval &fg_eval,
+                    CppAD::ipopt::solve_result<Dvector> &solution, SolveStats &stats,
+                    const std::function<bool()> &cancelled = std::function<bool()>())
+{
+  typedef typename FG_eval::ADvector ADvector;
+  stats = SolveStats();
+  Ipopt::SmartPtr<Ipopt::IpoptApplication> app = new Ipopt::IpoptApplication();
+  // One option per line: "Retape <bool>", "Sparse <bool> forward|reverse",
+  // or "String|Numeric|Integer <name> <value>" for Ipopt itself.
+  bool retape = false;
+  bool sparse_forward = false;
+  bool sparse_reverse = false;
+  std::istringstream lines(options);
+  string line;
+  while (std::getline(lines, line))
+  {
+    std::istringstream tokens(line);
+    string kind, name, value;
+    if (!(tokens >> kind >> name)) { continue; }
+    tokens >> value;
+    if (kind == "Retape") { retape = name == "true"; }
+    else if (kind == "Sparse")
+    {
+      if (value == "forward") { sparse_forward = name == "true"; }
+      else if (value == "reverse") { sparse_reverse = name == "true"; }
+    }
+    else if (kind == "String") { app->Options()->SetStringValue(name, value); }
+    else if (kind == "Numeric") { app->Options()->SetNumericValue(name, atof(value.c_str())); }
+    else if (kind == "Integer") { app->Options()->SetIntegerValue(name, atoi(value.c_str())); }
+  }
+#if IPOPT_VERSION_MAJOR > 3 || IPOPT_VERSION_MINOR >= 13
+  // Ipopt only times the linear solver when asked to since 3.13.
+  app->Options()->SetStringValue("timing_statistics", "yes");
+#endif
+  // The NLP records the CppAD tape when it is built, which is not Ipopt.
+  auto taping = std::chrono::steady_clock::now();
+  Ipopt::SmartPtr<Ipopt::TNLP> nlp = new StatsCallback<Dvector, ADvector, FG_eval>(
+    xi.size(), gl.size(), xi, xl, xu, gl, gu, fg_eval, retape, sparse_forward,
+    sparse_reverse, solution, stats, cancelled);
+  auto start = std::chrono::steady_clock::now();
+  stats.tape_time = std::chrono::duration<double>(start - taping).count();
+  if (TraceEnabled()) { TraceComplete("tape", TraceTime(taping), TraceTime(start)); }
+  PerfScope perf(PERF_IPOPT);
+  if (app->Initialize() != Ipopt::Solve_Succeeded)
+  {
+    solution.status = CppAD::ipopt::solve_result<Dvector>::unknown;
+    return;
+  }
+  app->OptimizeTNLP(nlp);
+  // Symbolic and numeric factorizations, back solves and scaling of the
+  // linear systems of the search direction.
+  Ipopt::SmartPtr<Ipopt::IpoptData> data = app->IpoptDataObject();
+  if (Ipopt::IsValid(data))
+  {
+    Ipopt::TimingStatistics &timing = data->TimingStats();
+    stats.linear_solver_time = timing.LinearSystemSymbolicFactorization().TotalWallclockTime() +
+                               timing.LinearSystemFactorization().TotalWallclockTime() +
+                               timing.LinearSystemBackSolve().TotalWallclockTime() +
+                               timing.LinearSystemScaling().TotalWallclockTime();
+  }
+  // Ipopt's own counts, when it got as far as to keep them.
+  Ipopt::SmartPtr<Ipopt::SolveStatistics> statistics = app->Statistics();
+  if (Ipopt::IsValid(statistics))
+  {
+    stats.iterations = statistics->IterationCount();
+    double dual_inf, constr_viol, complementarity, kkt_error;
+    statistics->Infeasibilities(dual_inf, constr_viol, complementarity, kkt_error);
+    stats.constraint_violation = constr_viol;
+    stats.dual_infeasibility = dual_inf;
+  }
+  auto end = std::chrono::steady_clock::now();
+  stats.total_time = std::chrono::duration<double>(end - start).count();
+  if (TraceEnabled()) { TraceComplete("ipopt", TraceTime(start), TraceTime(end), stats.iterations); }
+}
+
+#endif /* IPOPT_STATS_H */
@@ -0,0 +1,138 @@
+#include "latency_histogram.h"
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram()
+{
+  Reset();
+}
+
+size_t LatencyHistogram::Bucket(uint64_t ns)
+{
+  // Values below 128 ns have a bucket each.
+  if (ns < 128) { return ns; }
+  // Keep the 7 most significant bits: 64 buckets per power of two.
+  size_t msb = 63 - __builtin_clzll(ns);
+  size_t shift = msb - 6;
+  size_t bucket = 128 + (shift - 1) * 64 + ((ns >> shift) - 64);
+  return bucket < n_buckets ? bucket : n_buckets - 1;
+}
+
+uint64_t LatencyHistogram::BucketUpper(size_t bucket)
+{
+  if (bucket < 128) { return bucket; }
+  size_t shift = (bucket - 128) / 64 + 1;
+  uint64_t sub = (bucket - 128) % 64 + 64;
+  return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(double seconds)
+{
+  uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+  counts[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum_ns.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t prev = max_ns.load(std::memory_order_relaxed);
+  while (ns > prev && !max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+}
+
+double LatencyHistogram::Mean() const
+{
+  uint64_t n = Count();
+  return n > 0 ? sum_ns.load(std::memory_order_relaxed) * 1e-9 / n : 0;
+}
+
+double LatencyHistogram::Max() const
+{
+  return max_ns.load(std::memory_order_relaxed) * 1e-9;
+}
+
+double LatencyHistogram::Percentile(double q) const
+{
+  uint64_t n = Count();
+  if (n == 0) { return 0; }
+  // Rank of the value, counted from 1.
+  uint64_t rank = (uint64_t)(q / 100 * n + 0.5);
+  if (rank < 1) { rank = 1; }
+  uint64_t seen = 0;
+  for (size_t b=0; b<n_buckets; b++)
+  {
+    seen += counts[b].load(std::memory_order_relaxed);
+    if (seen >= rank)
+    {
+      // The bucket bound may overshoot the largest value recorded.
+      uint64_t upper = BucketUpper(b);
+      uint64_t largest = max_ns.load(std::memory_order_relaxed);
+      return (upper < largest ? upper : largest) * 1e-9;
+    }
+  }
+  return Max();
+}
+
+uint64_t LatencyHistogram::CountBelow(double seconds) const
+{
+  uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+  uint64_t below = 0;
+  for (size_t b=0; b<n_buckets && BucketUpper(b) <= ns; b++)
+  {
+    below += counts[b].load(std::memory_order_relaxed);
+  }
+  return below;
+}
+
+void LatencyHistogram::Reset()
+{
+  for (size_t b=0; b<n_buckets; b++) { counts[b].store(0, std::memory_order_relaxed); }
+  count.store(0, std::memory_order_relaxed);
+  sum_ns.store(0, std::memory_order_relaxed);
+  max_ns.store(0, std::memory_order_relaxed);
+}
+
+LoopLatency::LoopLatency(double period) : period(period), misses(0) {}
+
+void LoopLatency::Record(Stage stage, double seconds)
+{
+  histograms[stage].Record(seconds);
+}
+
+void LoopLatency::RecordCycle(double seconds)
+{
+  histograms[CYCLE].Record(seconds);
+  if (seconds > period) { misses.fetch_add(1, std::memory_order_relaxed); }
+}
+
+const char *LoopLatency::StageName(Stage stage)
+{
+  static const char *names[N_STAGES] = {
+    "parse", "transform", "fit", "solve", "serialize", "send", "cycle"
+  };
+  return names[stage];
+}
+
+string LoopLatency::Report() const
+{
+  string report;
+  char line[160];
+  snprintf(line, sizeof(line), "%-10s %8s %9s %9s %9s %9s %9s %9s\n", "stage [ms]",
+           "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+  report += line;
+  for (size_t i=0; i<N_STAGES; i++)
+  {
+    const LatencyHistogram &h = histograms[i];
+    snprintf(line, sizeof(line), "%-10s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+             StageName((Stage)i), (unsigned long long)h.Count(), 1000 * h.Mean(),
+             1000 * h.Percentile(50), 1000 * h.Percentile(90), 1000 * h.Percentile(99),
+             1000 * h.Percentile(99.9), 1000 * h.Max());
+    report += line;
+  }
+  snprintf(line, sizeof(line), "deadline misses: %llu of %llu cycles over %.1f ms\n",
+           (unsigned long long)DeadlineMisses(),
+           (unsigned long long)histograms[CYCLE].Count(), 1000 * period);
+  report += line;
+  return report;
+}
+
+void LoopLatency::Reset()
+{
+  for (size_t i=0; i<N_STAGES; i++) { histograms[i].Reset(); }
+  misses.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,93 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+// Histogram of latencies with a bounded relative error, in the style of
+// HdrHistogram: values are kept in nanoseconds in buckets whose width
+// doubles every 64 buckets, so each bucket is within 1/64 of its value, from
+// 1 ns up to 2^41 ns, about 36 minutes. Recording is a few relaxed atomic
+// increments, and the histogram can be read from any thread while it is
+// recorded.
+class LatencyHistogram {
+public:
+  LatencyHistogram();
+
+  // Record a latency in seconds.
+  void Record(double seconds);
+
+  uint64_t Count() const { return count.load(std::memory_order_relaxed); }
+  // Mean and largest latency in seconds.
+  double Mean() const;
+  double Max() const;
+  // Latency in seconds below which `q` percent of the values are, the upper
+  // bound of the bucket.
+  double Percentile(double q) const;
+
+  // Number of values up to `seconds`, counting whole buckets, e.g. for the
+  // cumulative buckets of a Prometheus histogram.
+  uint64_t CountBelow(double seconds) const;
+  // Sum of the values in seconds.
+  double Sum() const { return sum_ns.load(std::memory_order_relaxed) * 1e-9; }
+
+  void Reset();
+
+  // Number of buckets of the histogram.
+  static const size_t n_buckets = 128 + 64 * 34;
+
+private:
+  std::atomic<uint64_t> counts[n_buckets];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum_ns;
+  std::atomic<uint64_t> max_ns;
+
+  static size_t Bucket(uint64_t ns);
+  static uint64_t BucketUpper(size_t bucket);
+};
+
+// Latencies of the stages of the control loop, and the cycles whose
+// processing time exceeded the control period.
+class LoopLatency {
+public:
+  enum Stage {
+    PARSE,
+    TRANSFORM,
+    FIT,
+    SOLVE,
+    SERIALIZE,
+    SEND,
+    // From receiving the telemetry to sending the reply, without the
+    // simulated actuation delay.
+    CYCLE,
+    N_STAGES
+  };
+
+  // `period` is the deadline of a cycle in seconds.
+  explicit LoopLatency(double period);
+
+  void Record(Stage stage, double seconds);
+  // Record the processing time of a cycle and check it against the period.
+  void RecordCycle(double seconds);
+
+  double Period() const { return period; }
+  uint64_t DeadlineMisses() const { return misses.load(std::memory_order_relaxed); }
+  const LatencyHistogram &Histogram(Stage stage) const { return histograms[stage]; }
+  static const char *StageName(Stage stage);
+
+  // Table of p50, p90, p99, p99.9 and max of each stage and the deadline
+  // misses, in milliseconds.
+  string Report() const;
+
+  void Reset();
+
+private:
+  double period;
+  LatencyHistogram histograms[N_STAGES];
+  std::atomic<uint64_t> misses;
+};
+
+#endif /* LATENCY_HISTOGRAM_H */
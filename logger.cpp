@@ -0,0 +1,253 @@
+#include "logger.h"
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace log_detail {
+std::atomic<int> level(LOG_INFO);
+}
+
+namespace {
+
+const size_t log_capacity = 4096;
+
+// Bounded multi-producer queue after D. Vyukov: a slot is free for the
+// producer of ticket t when its sequence is t, and holds an entry for the
+// consumer when it is t + 1.
+struct alignas(64) Slot {
+  std::atomic<uint64_t> sequence;
+  LogEntry entry;
+};
+
+Slot *slots = NULL;
+alignas(64) std::atomic<uint64_t> enqueue_pos(0);
+alignas(64) std::atomic<uint64_t> dequeue_pos(0);
+// Entries before this one are written to stdout.
+std::atomic<uint64_t> written_pos(0);
+std::atomic<uint64_t> dropped(0);
+std::once_flag started;
+
+const char *level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+void Append(string &out, const LogEntry &e, const LogArg &arg)
+{
+  char value[64];
+  switch (arg.type)
+  {
+  case LogArg::INT: snprintf(value, sizeof(value), "%lld", (long long)arg.i); break;
+  case LogArg::UINT: snprintf(value, sizeof(value), "%llu", (unsigned long long)arg.u); break;
+  // As std::cout prints it by default.
+  case LogArg::DOUBLE: snprintf(value, sizeof(value), "%g", arg.d); break;
+  case LogArg::BOOL: snprintf(value, sizeof(value), "%d", arg.i != 0); break;
+  case LogArg::STRING: out.append(e.text + arg.s.offset, arg.s.length); return;
+  }
+  out += value;
+}
+
+void Format(string &out, const LogEntry &e)
+{
+  char prefix[48];
+  snprintf(prefix, sizeof(prefix), "%.6f %-5s ", e.time_ns * 1e-9, level_names[e.level]);
+  out += prefix;
+  size_t k = 0;
+  for (const char *c=e.format; *c; c++)
+  {
+    if (c[0] == '{' && c[1] == '}' && k < e.n_args)
+    {
+      Append(out, e, e.args[k++]);
+      c++;
+    }
+    else
+    {
+      out += *c;
+    }
+  }
+  if (e.suppressed > 0)
+  {
+    snprintf(prefix, sizeof(prefix), " (%u suppressed)", e.suppressed);
+    out += prefix;
+  }
+  out += '\n';
+}
+
+// Format and write whatever is in the ring, sleep when it is empty.
+void Consume()
+{
+  string out;
+  while (true)
+  {
+    uint64_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Slot &slot = slots[pos % log_capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+    {
+      if (!out.empty())
+      {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+        out.clear();
+      }
+      written_pos.store(pos, std::memory_order_release);
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    Format(out, slot.entry);
+    slot.sequence.store(pos + log_capacity, std::memory_order_release);
+    dequeue_pos.store(pos + 1, std::memory_order_release);
+  }
+}
+
+void Start()
+{
+  void *memory = NULL;
+  if (posix_memalign(&memory, 64, log_capacity * sizeof(Slot)) != 0) { abort(); }
+  slots = new (memory) Slot[log_capacity];
+  for (size_t i=0; i<log_capacity; i++) { slots[i].sequence.store(i); }
+  std::thread(Consume).detach();
+}
+
+}  // namespace
+
+LogEntry *log_detail::Claim(uint64_t &ticket)
+{
+  std::call_once(started, Start);
+  uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  while (true)
+  {
+    Slot &slot = slots[pos % log_capacity];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == pos)
+    {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      {
+        ticket = pos;
+        return &slot.entry;
+      }
+    }
+    else if (sequence < pos)
+    {
+      // Full: the consumer has not freed this slot yet.
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return NULL;
+    }
+    else
+    {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void log_detail::Commit(uint64_t ticket)
+{
+  slots[ticket % log_capacity].sequence.store(ticket + 1, std::memory_order_release);
+}
+
+int64_t log_detail::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void log_detail::Put(LogEntry &e, double v)
+{
+  LogArg &arg = e.args[e.n_args++];
+  arg.type = LogArg::DOUBLE;
+  arg.d = v;
+}
+
+void log_detail::Put(LogEntry &e, long long v)
+{
+  LogArg &arg = e.args[e.n_args++];
+  arg.type = LogArg::INT;
+  arg.i = v;
+}
+
+void log_detail::Put(LogEntry &e, unsigned long long v)
+{
+  LogArg &arg = e.args[e.n_args++];
+  arg.type = LogArg::UINT;
+  arg.u = v;
+}
+
+void log_detail::Put(LogEntry &e, bool v)
+{
+  LogArg &arg = e.args[e.n_args++];
+  arg.type = LogArg::BOOL;
+  arg.i = v;
+}
+
+void log_detail::Put(LogEntry &e, const char *v, size_t length)
+{
+  LogArg &arg = e.args[e.n_args++];
+  arg.type = LogArg::STRING;
+  size_t room = log_text_size - e.text_used;
+  if (length > room)
+  {
+    size_t cut = room > 3 ? room - 3 : 0;
+    memcpy(e.text + e.text_used, v, cut);
+    memcpy(e.text + e.text_used + cut, "...", room - cut);
+    length = room;
+  }
+  else
+  {
+    memcpy(e.text + e.text_used, v, length);
+  }
+  arg.s.offset = e.text_used;
+  arg.s.length = length;
+  e.text_used += length;
+}
+
+bool LogRate::Allow(uint32_t &n)
+{
+  int64_t now = log_detail::Now();
+  int64_t next = next_ns.load(std::memory_order_relaxed);
+  if (now < next || !next_ns.compare_exchange_strong(next, now + interval_ns))
+  {
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  n = suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+void SetLogLevel(LogLevel level)
+{
+  log_detail::level.store(level);
+}
+
+uint64_t LogDropped()
+{
+  return dropped.load(std::memory_order_relaxed);
+}
+
+void FlushLog()
+{
+  uint64_t end = enqueue_pos.load();
+  while (written_pos.load() < end)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void FlushLogOnExit()
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  std::thread([signals]() {
+    int signum;
+    while (sigwait(&signals, &signum) != 0) {}
+    FlushLog();
+    // The other threads are still running, so skip the destructors of
+    // the statics they use.
+    _exit(128 + signum);
+  }).detach();
+}
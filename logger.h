@@ -0,0 +1,156 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+// Asynchronous log for the control loop. Log() copies its arguments into a
+// fixed size entry of a lock-free ring buffer and returns, a background
+// thread formats the entries and writes them to stdout. The calling thread
+// never formats, allocates, blocks or does I/O. When the ring is full the
+// entry is dropped and counted, see LogDropped().
+//
+// The format is a string literal with one {} per argument, e.g.
+//   Log(LOG_INFO, "Cost {} Iterations {}", cost, iterations);
+// Arguments are numbers, bools and strings. Strings are copied, up to the
+// room left in the entry, and a string cut short ends with "...".
+
+enum LogLevel {
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR
+};
+
+const size_t log_max_args = 6;
+// An entry with its slot in the ring takes 512 bytes.
+const size_t log_text_size = 376;
+
+struct LogArg {
+  enum Type { INT, UINT, DOUBLE, BOOL, STRING } type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    // Part of LogEntry::text.
+    struct {
+      uint16_t offset;
+      uint16_t length;
+    } s;
+  };
+};
+
+struct LogEntry {
+  int64_t time_ns;
+  // String literal, not copied.
+  const char *format;
+  // Entries suppressed by the rate limit of the call site since the
+  // previous one.
+  uint32_t suppressed;
+  uint8_t level;
+  uint8_t n_args;
+  uint16_t text_used;
+  LogArg args[log_max_args];
+  char text[log_text_size];
+};
+
+// Entries below this level are skipped by the caller, LOG_INFO by default.
+void SetLogLevel(LogLevel level);
+// Number of entries lost because the ring was full.
+uint64_t LogDropped();
+// Wait until the entries logged so far are written.
+void FlushLog();
+// On SIGINT or SIGTERM, write the entries logged so far and exit. The
+// signals are handled by a thread of its own, so this must be called before
+// any other thread is started, which inherit the blocked signals.
+void FlushLogOnExit();
+
+// At most one entry per `interval` seconds from a call site, e.g.
+//   static LogRate rate(1.0);
+//   LogRated(rate, LOG_WARN, "solve failed");
+// The next entry that passes tells how many were suppressed.
+class LogRate {
+public:
+  LogRate(double interval) : interval_ns(interval * 1e9), next_ns(0), suppressed(0) {}
+  // Whether an entry may pass now. If so, `n` is set to the number of
+  // entries suppressed before it.
+  bool Allow(uint32_t &n);
+
+private:
+  int64_t interval_ns;
+  std::atomic<int64_t> next_ns;
+  std::atomic<uint32_t> suppressed;
+};
+
+namespace log_detail {
+extern std::atomic<int> level;
+// A free entry of the ring, or NULL when it is full. `ticket` is passed to
+// Commit once the entry is filled.
+LogEntry *Claim(uint64_t &ticket);
+void Commit(uint64_t ticket);
+int64_t Now();
+
+void Put(LogEntry &e, double v);
+void Put(LogEntry &e, long long v);
+void Put(LogEntry &e, unsigned long long v);
+void Put(LogEntry &e, bool v);
+void Put(LogEntry &e, const char *v, size_t length);
+inline void Put(LogEntry &e, float v) { Put(e, (double)v); }
+inline void Put(LogEntry &e, int v) { Put(e, (long long)v); }
+inline void Put(LogEntry &e, long v) { Put(e, (long long)v); }
+inline void Put(LogEntry &e, unsigned v) { Put(e, (unsigned long long)v); }
+inline void Put(LogEntry &e, unsigned long v) { Put(e, (unsigned long long)v); }
+inline void Put(LogEntry &e, const char *v) { Put(e, v, strlen(v)); }
+inline void Put(LogEntry &e, const string &v) { Put(e, v.data(), v.size()); }
+
+inline void PutAll(LogEntry &) {}
+template <class T, class... Rest>
+void PutAll(LogEntry &e, const T &v, const Rest &... rest)
+{
+  if (e.n_args < log_max_args) { Put(e, v); }
+  PutAll(e, rest...);
+}
+
+template <class... Args>
+void Write(uint32_t suppressed, LogLevel level, const char *format, const Args &... args)
+{
+  uint64_t ticket;
+  LogEntry *e = Claim(ticket);
+  if (e == NULL) { return; }
+  e->time_ns = Now();
+  e->format = format;
+  e->suppressed = suppressed;
+  e->level = level;
+  e->n_args = 0;
+  e->text_used = 0;
+  PutAll(*e, args...);
+  Commit(ticket);
+}
+}  // namespace log_detail
+
+inline bool LogEnabled(LogLevel level)
+{
+  return level >= log_detail::level.load(std::memory_order_relaxed);
+}
+
+template <class... Args>
+void Log(LogLevel level, const char *format, const Args &... args)
+{
+  if (LogEnabled(level)) { log_detail::Write(0, level, format, args...); }
+}
+
+template <class... Args>
+void LogRated(LogRate &rate, LogLevel level, const char *format, const Args &... args)
+{
+  uint32_t suppressed;
+  if (LogEnabled(level) && rate.Allow(suppressed))
+  {
+    log_detail::Write(suppressed, level, format, args...);
+  }
+}
+
+#endif /* LOGGER_H */
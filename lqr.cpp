@@ -0,0 +1,21 @@
+#include "lqr.h"
+#include "Eigen-3.3/Eigen/LU"
+
+Eigen::MatrixXd SolveDARE(const Eigen::MatrixXd &A, const Eigen::MatrixXd &B,
+                          const Eigen::MatrixXd &Q, const Eigen::MatrixXd &R,
+                          size_t max_iter, double tol)
+{
+  Eigen::MatrixXd P = Q;
+  for (size_t k=0; k<max_iter; k++)
+  {
+    Eigen::MatrixXd BtPA = B.transpose() * P * A;
+    Eigen::MatrixXd next = Q + A.transpose() * P * A
+      - BtPA.transpose() * (R + B.transpose() * P * B).lu().solve(BtPA);
+    // Keep P symmetric against rounding.
+    next = 0.5 * (next + next.transpose());
+    double change = (next - P).cwiseAbs().maxCoeff();
+    P = next;
+    if (change <= tol * (1 + P.cwiseAbs().maxCoeff())) { break; }
+  }
+  return P;
+}
@@ -0,0 +1,73 @@
+#ifndef LQR_H
+#define LQR_H
+
+#include "Eigen-3.3/Eigen/Core"
+#include "integrator.h"
+#include "vehicle_model.h"
+
+// Solve the discrete algebraic Riccati equation
+// P = Q + A' P A - A' P B (R + B' P B)^-1 B' P A
+// by fixed point iteration, starting from P = Q.
+Eigen::MatrixXd SolveDARE(const Eigen::MatrixXd &A, const Eigen::MatrixXd &B,
+                          const Eigen::MatrixXd &Q, const Eigen::MatrixXd &R,
+                          size_t max_iter = 1000, double tol = 1e-9);
+
+// Quadratic terminal cost matrix P of a model: the infinite horizon LQR cost
+// of the model linearized on a straight reference line at speed `v`, with
+// the actuators at zero, discretized over intervals of `dt` with the given
+// integrator. `q` and `r` are the diagonal stage weights of the states and
+// actuators.
+//
+// The linearization uses the continuous derivative of the model, in which
+// cte and epsi evolve by themselves and x, y, psi do not feed back into the
+// weighted states. Their rows and columns of P are therefore zero, and
+// P only penalises the deviation of the path-relative states.
+template <class Model>
+Eigen::MatrixXd TerminalCostMatrix(double v, double dt, Integrator integrator,
+                                   size_t substeps, const Eigen::VectorXd &q,
+                                   const Eigen::VectorXd &r)
+{
+  const size_t ns = Model::n_states;
+  const size_t nu = Model::n_inputs;
+  // Reference point and zero stage parameters, i.e. a straight line.
+  double s_ref[ns] = {};
+  double u_ref[nu] = {};
+  double p[Model::n_params + 1] = {};
+  s_ref[Model::V] = v;
+  // One discrete step s + ds(s, u) around the reference, differentiated by
+  // central differences.
+  const double eps = 1e-6;
+  Eigen::MatrixXd A(ns, ns);
+  Eigen::MatrixXd B(ns, nu);
+  for (size_t k=0; k<ns + nu; k++)
+  {
+    double s_hi[ns], s_lo[ns], u_hi[nu], u_lo[nu];
+    for (size_t i=0; i<ns; i++) { s_hi[i] = s_lo[i] = s_ref[i]; }
+    for (size_t j=0; j<nu; j++) { u_hi[j] = u_lo[j] = u_ref[j]; }
+    if (k < ns)
+    {
+      s_hi[k] += eps;
+      s_lo[k] -= eps;
+    }
+    else
+    {
+      u_hi[k - ns] += eps;
+      u_lo[k - ns] -= eps;
+    }
+    ModelDerivative<Model, double> f_hi = {u_hi, p};
+    ModelDerivative<Model, double> f_lo = {u_lo, p};
+    double ds_hi[ns], ds_lo[ns];
+    IntegrateIncrement<ns>(integrator, substeps, f_hi, s_hi, dt, ds_hi);
+    IntegrateIncrement<ns>(integrator, substeps, f_lo, s_lo, dt, ds_lo);
+    for (size_t i=0; i<ns; i++)
+    {
+      double d = ((s_hi[i] + ds_hi[i]) - (s_lo[i] + ds_lo[i])) / (2 * eps);
+      if (k < ns) { A(i, k) = d; } else { B(i, k - ns) = d; }
+    }
+  }
+  Eigen::MatrixXd Q = q.asDiagonal();
+  Eigen::MatrixXd R = r.asDiagonal();
+  return SolveDARE(A, B, Q, R);
+}
+
+#endif /* LQR_H */
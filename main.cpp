@@ -1,266 +1,374 @@
 #include <math.h>
+#include <signal.h>
 #include <uWS/uWS.h>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
-#include "Eigen-3.3/Eigen/QR"
 #include "MPC.h"
+#include "control_session.h"
+#include "controller.h"
+#include "cost_weights.h"
 #include "json.hpp"
+#include "latency_histogram.h"
+#include "logger.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "reply_writer.h"
+#include "shm_transport.h"
+#include "telemetry_log.h"
+#include "trace.h"
+#include "wire_format.h"
 
 // for convenience
 using json = nlohmann::json;
 
-// For converting back and forth between radians and degrees.
-constexpr double pi() { return M_PI; }
-double deg2rad(double x) { return x * pi() / 180; }
-double rad2deg(double x) { return x * 180 / pi(); }
+// State of one websocket connection, see onConnection. Replies go back
+// on the connection, formatted as it asked for.
+struct Connection : public ReplySink {
+  uWS::WebSocket<uWS::SERVER> ws;
+  ReplyOptions options;
+  // The reply buffer of the connection.
+  ReplyWriter writer;
+  // Steer replies sent so far.
+  size_t replies;
+  Connection(uWS::WebSocket<uWS::SERVER> ws, const ReplyOptions &options)
+    : ws(ws), options(options), writer(options.precision, options.format), replies(0) {}
 
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s)
-{
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.rfind("}]");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
+  void Format(double steering, double throttle, const ControlOutput &out, size_t N)
+  {
+    const vector<double> &pred_info = out.pred_info;
+    size_t n_pts = out.xvals.size();
+    //Display the MPC predicted trajectory
+    //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+    // the points in the simulator are connected by a Green line
+    // The points follow N zeros, as the simulator has always been sent,
+    // unless the connection turned the padding off. The zeros are strided
+    // as the points are.
+    size_t k = options.stride;
+    size_t n_plan = (pred_info.size() - 2) / 2;
+    size_t pad = options.pad ? (N + k - 1) / k : 0;
+    Series mpc_x(pred_info.data() + 2, (n_plan + k - 1) / k, 2 * k, pad);
+    Series mpc_y(pred_info.data() + 3, (n_plan + k - 1) / k, 2 * k, pad);
+    //Display the waypoints/reference line
+    //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
+    // the points in the simulator are connected by a Yellow line
+    Series next_x(out.xvals.data(), (n_pts + k - 1) / k, k);
+    Series next_y(out.yvals.data(), (n_pts + k - 1) / k, k);
+
+    // Written straight into the buffer of the connection, see
+    // reply_writer.h. A headless client may skip the visualization.
+    bool visualize = options.visualization && replies++ % options.every == 0;
+    if (visualize) { writer.Steer(steering, throttle, mpc_x, mpc_y, next_x, next_y); }
+    else { writer.Actuation(steering, throttle); }
+    if (LogEnabled(LOG_DEBUG) && !writer.Binary())
+    {
+      Log(LOG_DEBUG, "{}", string(writer.Data(), writer.Size()));
+    }
   }
-  return "";
-}
 
-// Evaluate a polynomial.
-double polyeval(Eigen::VectorXd coeffs, double x)
-{
-  double result = 0.0;
-  for (int i = 0; i < coeffs.size(); i++)
+  void Send()
   {
-    result += coeffs[i] * pow(x, i);
+    ws.send(writer.Data(), writer.Size(),
+            writer.Binary() ? uWS::OpCode::BINARY : uWS::OpCode::TEXT);
   }
-  return result;
-}
+};
 
-// Fit a polynomial.
-// Adapted from
-// https://github.com/JuliaMath/Polynomials.jl/blob/master/src/Polynomials.jl#L676-L716
-Eigen::VectorXd polyfit(Eigen::VectorXd xvals, Eigen::VectorXd yvals, int order)
-{
-  assert(xvals.size() == yvals.size());
-  assert(order >= 1 && order <= xvals.size() - 1);
-  Eigen::MatrixXd A(xvals.size(), order + 1);
-  for (int i = 0; i < xvals.size(); i++)
+// The client on the shared memory segment, see shm_transport.h.
+struct ShmClient : public ReplySink {
+  ShmSegment *segment;
+  ShmCommand command;
+  explicit ShmClient(ShmSegment *segment) : segment(segment) {}
+
+  void Format(double steering, double throttle, const ControlOutput &out, size_t N)
   {
-    A(i, 0) = 1.0;
+    command.steering_angle = steering;
+    command.throttle = throttle;
   }
-  for (int j = 0; j < xvals.size(); j++)
+
+  void Send()
   {
-    for (int i = 0; i < order; i++) {
-      A(j, i + 1) = A(j, i) * xvals(j);
+    if (!segment->commands.Push(command))
+    {
+      static LogRate full_rate(1.0);
+      LogRated(full_rate, LOG_WARN, "Shared memory client does not read its commands");
     }
   }
-  auto Q = A.householderQr();
-  auto result = Q.solve(yvals);
-  return result;
-}
+};
 
-// Transfer from map/global coordinate system to vehicle/local coordinate system.
-// In the vehicle/local system, the position px = py = 0, and orientation psi = 0,
-// which can simplify future calculations.
-void globalToLocal(vector<double> &ptsx, vector<double> &ptsy, double px, double py,
-                   double psi, Eigen::VectorXd &xvals, Eigen::VectorXd &yvals)
+// Serve the client of the shared memory segment until the process exits.
+void ServeShm(ShmSegment *segment, ControlSession *session, TelemetryLogWriter *recorder)
 {
-  for (size_t i=0; i<ptsx.size(); i++)
+  SetTraceThreadName("shm");
+  ShmClient client(segment);
+  ShmTelemetry record;
+  Telemetry telemetry;
+  double sim_time;
+  string error;
+  LogRate invalid_rate(1.0);
+  while (true)
   {
-    double dx = ptsx[i] - px;
-    double dy = ptsy[i] - py;
-    xvals[i] = dx * cos(-psi) - dy * sin(-psi);
-    yvals[i] = dx * sin(-psi) + dy * cos(-psi);
+    segment->telemetry.Pop(record, -1);
+    int64_t received_ns = recorder->Now();
+    auto received = std::chrono::steady_clock::now();
+    Count(MESSAGES_RECEIVED);
+    if (record.first != 0) { session->Reset(); }
+    if (!FromShm(record, telemetry, sim_time, error))
+    {
+      LogRated(invalid_rate, LOG_WARN, "Invalid telemetry: {}", error);
+      continue;
+    }
+    session->Handle(telemetry, sim_time, received, received_ns, client);
   }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  // Write out the log when stopped with Ctrl-C, before any thread starts.
+  FlushLogOnExit();
   uWS::Hub h;
   // MPC is initialized here!
-  MPC mpc;
-  // This is the length from front to CoG that has a similar radius.
-  double Lf = 2.67;
-  // steps
-  int N = 10;
-    
-  // Set a variable to save the previous time stamp.
-  // This is used to estimate the latency
-  std::chrono::time_point<std::chrono::system_clock> time_pre;
-  
-  bool latency_init = true;
+  // With --adaptive-horizon the horizon is picked every cycle from the
+  // current speed.
+  Controller controller;
+  AdaptiveMPC &mpc = controller.mpc;
+  // Usage: mpc [weights.json] [--record session.log] [--period s] [--verbose]
+  //            [--trace trace.json] [--perf] [--log-level debug|info|warn|error]
+  //            [--reply viz=off&viz_stride=2&viz_every=5&viz_pad=0&precision=6]
+  //            [--shm name] [--speculate] [--adaptive-horizon]
+  // Cost weights, optionally from a JSON config file. The file can be
+  // reloaded while running, see onHttpRequest.
+  string weights_path;
+  // Record the telemetry and the steer replies to a binary log, see
+  // telemetry_log.h.
+  TelemetryLogWriter recorder;
+  // Deadline of the processing of a cycle in seconds, and whether to print
+  // the latencies and the cost of every cycle.
+  double period = 0.1;
+  // What the steer replies carry, unless a connection asks otherwise in the
+  // query of its URL, see reply_writer.h.
+  ReplyOptions reply_options;
+  // Also serve a simulator on the same host through shared memory, see
+  // shm_transport.h.
+  ShmChannel shm;
+  // Solve for the predicted next telemetry while waiting for it, see
+  // ControlSession::Speculate.
+  bool speculate = false;
+  controller.verbose = false;
+  for (int i=1; i<argc; i++)
+  {
+    if (string(argv[i]) == "--period" && i + 1 < argc)
+    {
+      period = atof(argv[++i]);
+    }
+    else if (string(argv[i]) == "--trace" && i + 1 < argc)
+    {
+      // Record the timeline from the start and write it on SIGUSR1, see
+      // trace.h. No other thread may exist yet.
+      DumpTraceOnSignal(SIGUSR1, argv[++i]);
+      StartTrace();
+    }
+    else if (string(argv[i]) == "--perf")
+    {
+      // Hardware counters of the stages, see GET /perf.
+      if (!EnablePerfStages()) { std::cerr << "perf_event_open is not available" << std::endl; }
+    }
+    else if (string(argv[i]) == "--log-level" && i + 1 < argc)
+    {
+      // The log is written by a background thread, see logger.h. debug
+      // adds the raw messages.
+      string level = argv[++i];
+      SetLogLevel(level == "debug" ? LOG_DEBUG : level == "warn" ? LOG_WARN
+                  : level == "error" ? LOG_ERROR : LOG_INFO);
+    }
+    else if (string(argv[i]) == "--reply" && i + 1 < argc)
+    {
+      string error;
+      if (!ParseReplyOptions(string("?") + argv[++i], reply_options, error))
+      {
+        std::cerr << error << std::endl;
+        return -1;
+      }
+    }
+    else if (string(argv[i]) == "--shm" && i + 1 < argc)
+    {
+      string error;
+      if (!shm.Create(argv[++i], error))
+      {
+        std::cerr << "Failed to create the shared memory: " << error << std::endl;
+        return -1;
+      }
+    }
+    else if (string(argv[i]) == "--speculate")
+    {
+      speculate = true;
+    }
+    else if (string(argv[i]) == "--adaptive-horizon")
+    {
+      // Half of the 100 ms actuation latency as the budget of a solve.
+      mpc.SetTable(AdaptiveMPC::SpeedTable(), 0.05);
+    }
+    else if (string(argv[i]) == "--verbose")
+    {
+      controller.verbose = true;
+    }
+    else if (string(argv[i]) == "--record" && i + 1 < argc)
+    {
+      string error;
+      if (!recorder.Open(argv[++i], error))
+      {
+        std::cerr << "Failed to open the log: " << error << std::endl;
+        return -1;
+      }
+    }
+    else
+    {
+      weights_path = argv[i];
+    }
+  }
+  if (weights_path != "")
+  {
+    CostWeights weights = mpc.Weights();
+    string error;
+    if (!LoadWeights(weights_path, weights, error))
+    {
+      std::cerr << "Failed to load the weights: " << error << std::endl;
+      return -1;
+    }
+    mpc.SetWeights(weights);
+  }
+  Log(LOG_INFO, "Weights: {}", WeightsToJson(mpc.Weights()));
+  // Latency of the stages of each cycle, see GET /latency.
+  LoopLatency loop_latency(period);
+  // The cycles of the controller, whichever transport the telemetry
+  // comes from, see control_session.h.
+  ControlSession session(controller, loop_latency, recorder);
+  if (speculate) { session.Speculate(SpeculationTolerance()); }
+  SetTraceThreadName("io");
 
-  h.onMessage([&mpc, &Lf, &N, &time_pre, &latency_init](uWS::WebSocket<uWS::SERVER> ws,
-                                                        char *data, size_t length,
-                                                        uWS::OpCode opCode)
+  h.onMessage([&session, &recorder](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+                                    uWS::OpCode opCode)
   {
-    // "42" at the start of the message means there's a websocket message event.
-    // The 4 signifies a websocket message
-    // The 2 signifies a websocket event
-    string sdata = string(data).substr(0, length);
-    //cout << sdata << endl;
-    if (sdata.size() > 2 && sdata[0] == '4' && sdata[1] == '2') {
+    int64_t received_ns = recorder.Now();
+    auto received = std::chrono::steady_clock::now();
+    Count(MESSAGES_RECEIVED);
+    Connection &connection = *static_cast<Connection *>(ws.getUserData());
+    Telemetry telemetry;
+    // Simulated time of the telemetry, NaN if the simulator has no clock.
+    double sim_time = NAN;
+    static LogRate invalid_rate(1.0);
+    string error;
+    if (opCode == uWS::OpCode::BINARY)
+    {
+      // A client that asked for a binary format, see wire_format.h.
+      bool ok;
+      {
+        PerfScope perf(PERF_JSON_PARSE);
+        ok = DecodeTelemetry(connection.options.format, data, length, telemetry, sim_time,
+                             error);
+      }
+      if (!ok)
+      {
+        LogRated(invalid_rate, LOG_WARN, "Invalid telemetry: {}", error);
+        return;
+      }
+    }
+    else
+    {
+      // "42" at the start of the message means there's a websocket message event.
+      // The 4 signifies a websocket message
+      // The 2 signifies a websocket event
+      string sdata = string(data).substr(0, length);
+      Log(LOG_DEBUG, "{}", sdata);
+      if (sdata.size() <= 2 || sdata[0] != '4' || sdata[1] != '2') { return; }
       string s = hasData(sdata);
-      if (s != "") {
-        auto j = json::parse(s);
-        string event = j[0].get<string>();
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          vector<double> ptsx = j[1]["ptsx"];
-          vector<double> ptsy = j[1]["ptsy"];
-          double px = j[1]["x"];
-          double py = j[1]["y"];
-          double psi = j[1]["psi"];
-          double v = j[1]["speed"];
-          
-          //std::cout << "speed: " << v << std::endl;
-          // Convert speed from mph to m/s
-          v *= 0.44704;
-          
-          // Obtain current actuator values [delta, a] = ["steering_angle","throttle"],
-          // which will be used in calibration of latency
-          double delta0 = j[1]["steering_angle"];
-          
-          //std::cout << "steering angle: " << delta0 << std::endl;
-          
-          double a0     = j[1]["throttle"];
-          
-          std::chrono::duration<double> elapsed_seconds = std::chrono::system_clock::now() - time_pre;
-          double latency_pre = elapsed_seconds.count();
-          std::cout << "real latency: " << latency_pre << std::endl;
-          
-          time_pre = std::chrono::system_clock::now();
-          
-          // Transform from global map system to local vehicle system so that the life is easier.
-          size_t n_pts = ptsx.size();
-          Eigen::VectorXd xvals(n_pts);
-          Eigen::VectorXd yvals(n_pts);
-          globalToLocal(ptsx, ptsy, px, py, psi, xvals, yvals);
-          // Fit for the reference line
-          Eigen::VectorXd coeffs = polyfit(xvals, yvals, 3);
-          // Calculate the cross track error in vehicle's coordinate system.
-          double cte = polyeval(coeffs, 0);
-          // Calculate the epsi in vehicle's coordinate system
-          double epsi = -atan(coeffs[1]);
-          // Calculate the new start state after the latency
-          // Recall in the local vehicle system, we have px = py = psi = 0, v=v
-          // We use the same equations of the model to obtain the new state:
-          // x_[t+1] = x[t] + v[t] * cos(psi[t]) * dt
-          // y_[t+1] = y[t] + v[t] * sin(psi[t]) * dt
-          // psi_[t+1] = psi[t] + v[t] / Lf * delta[t] * dt
-          // v_[t+1] = v[t] + a[t] * dt
-          // cte[t+1] = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
-          // epsi[t+1] = psi[t] - psides[t] + v[t] * delta[t] / Lf * dt
-          //double latency = 0.1 + 0.05; // TUNE LATER
-          // Handle latency
-          double latency;
-          if (!latency_init)
-          {
-            latency = latency_pre;
-          }
-          else
-          {
-            std::cout << "Latency initialization!" << std::endl;
-            latency = 0.15;
-            latency_init = false;
-          }
-          if (latency >= 0.25) { latency = 0.25; }
-          std::cout << "latency used: " << latency << std::endl;
-          
-          double x0      = v * latency;
-          double y0      = 0;
-          double psi0    = - v / Lf * delta0 * latency;
-          double v0      = v + a0 * latency;
-          double cte0    = cte + v * sin(epsi) * latency;
-          double epsi0   = epsi - v / Lf * delta0 * latency;
-          Eigen::VectorXd state(6);
-          state << x0, y0, psi0, v0, cte0, epsi0;
-          // Use MPC to obtain a decent steering angle and throttle.
-          // Both are in between [-1, 1].
-          vector<double> pred_info = mpc.Solve(state, coeffs);
-          // Recall the first two components contain actuation values [steer_value, throttle_value],
-          // followed with N
-          double steer_value    = pred_info[0];
-          double throttle_value = pred_info[1];
-
-          json msgJson;
-          // NOTE: Remember to divide by deg2rad(25) before you send the steering value back.
-          // Otherwise the values will be in between [-deg2rad(25), deg2rad(25] instead of [-1, 1].
-          msgJson["steering_angle"] = steer_value/deg2rad(25);
-          //std::cout << "Steering Angle: " << steer_value << std::endl;
-          msgJson["throttle"] = throttle_value;
-          
-          
-          //Display the MPC predicted trajectory
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Green line
-          vector<double> mpc_x_vals(N);
-          vector<double> mpc_y_vals(N);
-          /*
-          for (size_t t=0; t<N; t++)
-          {
-            mpc_x_vals[t] = pred_info[t+2];
-            mpc_y_vals[t] = pred_info[t+N+2];
-          }*/
-          
-          for (size_t t=2; t<pred_info.size(); t+=2)
-          {
-            mpc_x_vals.push_back(pred_info[t]);
-            mpc_y_vals.push_back(pred_info[t+1]);
-          }
-          
-          msgJson["mpc_x"] = mpc_x_vals;
-          msgJson["mpc_y"] = mpc_y_vals;
-          //Display the waypoints/reference line
-          //.. add (x,y) points to list here, points are in reference to the vehicle's coordinate system
-          // the points in the simulator are connected by a Yellow line
-          vector<double> next_x_vals(n_pts);
-          vector<double> next_y_vals(n_pts);
-          for (size_t t=0; t<n_pts; t++)
-          {
-            next_x_vals[t] = xvals[t];
-            next_y_vals[t] = yvals[t];
-          }
-          
-          msgJson["next_x"] = next_x_vals;
-          msgJson["next_y"] = next_y_vals;
-
-          auto msg = "42[\"steer\"," + msgJson.dump() + "]";
-          //std::cout << msg << std::endl;
-          // Latency
-          // The purpose is to mimic real driving conditions where
-          // the car does actuate the commands instantly.
-          //
-          // Feel free to play around with this value but should be to drive
-          // around the track with 100ms latency.
-          //
-          // NOTE: REMEMBER TO SET THIS TO 100 MILLISECONDS BEFORE
-          // SUBMITTING.
-          this_thread::sleep_for(chrono::milliseconds(100));
-          ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-        }
-      } else {
+      if (s == "") {
         // Manual driving
         std::string msg = "42[\"manual\",{}]";
         ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
+        Count(MESSAGES_SENT);
+        return;
+      }
+      json j;
+      {
+        PerfScope perf(PERF_JSON_PARSE);
+        j = json::parse(s);
+      }
+      string event = j[0].get<string>();
+      if (event != "telemetry") { return; }
+      // j[1] is the data JSON object
+      if (!TelemetryFromJson(j[1], telemetry, sim_time, error))
+      {
+        LogRated(invalid_rate, LOG_WARN, "Invalid telemetry: {}", error);
+        return;
       }
     }
+    // Solve and reply on the connection, see control_session.cpp.
+    session.Handle(telemetry, sim_time, received, received_ns, connection);
   });
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
-  h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
-                     size_t, size_t) {
+  // Tune the cost weights while running:
+  //   GET  /weights         current weights as JSON
+  //   POST /weights         update the weights from a (partial) JSON object
+  //   POST /weights/reload  reload the config file
+  // The weights are read at every solve, so they apply from the next cycle.
+  // Latencies of the loop:
+  //   GET  /latency         percentiles of each stage and deadline misses
+  //   POST /latency         the same, then start over
+  // Monitoring:
+  //   GET  /metrics         counters, gauges and histograms for Prometheus
+  //   GET  /trace           timeline in the Chrome trace format, see trace.h
+  //   POST /trace/start     start recording the timeline
+  //   POST /trace/stop      stop recording it
+  //   GET  /perf            hardware counters per stage with --perf
+  h.onHttpRequest([&mpc, &session, &weights_path, &loop_latency](uWS::HttpResponse *res,
+                                                                 uWS::HttpRequest req,
+                                                                 char *data, size_t length,
+                                                                 size_t remaining) {
     const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1) {
+    std::string url = req.getUrl().toString();
+    if (url == "/metrics") {
+      std::string body = PrometheusText(loop_latency);
+      res->end(body.data(), body.length());
+    } else if (url == "/perf") {
+      std::string body = PerfReport();
+      res->end(body.data(), body.length());
+    } else if (url == "/trace") {
+      std::string body = TraceJson();
+      res->end(body.data(), body.length());
+    } else if ((url == "/trace/start" || url == "/trace/stop") &&
+               req.getMethod() == uWS::HttpMethod::METHOD_POST) {
+      if (url == "/trace/start") { StartTrace(); } else { StopTrace(); }
+      std::string body = TraceEnabled() ? "tracing\n" : "not tracing\n";
+      res->end(body.data(), body.length());
+    } else if (url == "/latency") {
+      std::string body = loop_latency.Report();
+      if (req.getMethod() == uWS::HttpMethod::METHOD_POST) { loop_latency.Reset(); }
+      res->end(body.data(), body.length());
+    } else if (url == "/weights" || url == "/weights/reload") {
+      // The shared memory client is served on another thread.
+      std::lock_guard<std::mutex> lock(session.mutex);
+      CostWeights weights = mpc.Weights();
+      string error;
+      bool ok = true;
+      if (req.getMethod() == uWS::HttpMethod::METHOD_POST) {
+        if (remaining > 0) {
+          ok = false;
+          error = "request body too large";
+        } else if (url == "/weights/reload") {
+          ok = weights_path != "" && LoadWeights(weights_path, weights, error);
+          if (weights_path == "") { error = "no config file"; }
+        } else {
+          ok = WeightsFromJson(string(data, length), weights, error);
+        }
+        if (ok) { mpc.SetWeights(weights); }
+        Log(ok ? LOG_INFO : LOG_WARN, "Weights: {}", ok ? WeightsToJson(weights) : error);
+      }
+      std::string body = ok ? WeightsToJson(weights) : "{\"error\":" + json(error).dump() + "}";
+      res->end(body.data(), body.length());
+    } else if (req.getUrl().valueLength == 1) {
       res->end(s.data(), s.length());
     } else {
       // i guess this should be done more gracefully?
@@ -268,22 +376,42 @@ int main() {
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
-    std::cout << "Connected!!!" << std::endl;
+  // A client can pick what its replies carry with the query of the URL,
+  // e.g. ws://localhost:4567/?viz=off, see ReplyOptions.
+  h.onConnection([&h, &session, &reply_options](uWS::WebSocket<uWS::SERVER> ws,
+                                                 uWS::HttpRequest req) {
+    ReplyOptions options = reply_options;
+    string error;
+    if (!ParseReplyOptions(req.getUrl().toString(), options, error))
+    {
+      Log(LOG_WARN, "{}, using the defaults", error);
+      options = reply_options;
+    }
+    ws.setUserData(new Connection(ws, options));
+    // Its clock starts again, if it sends one.
+    session.Reset();
+    Log(LOG_INFO, "Connected!!!");
   });
 
   h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
                          char *message, size_t length) {
     ws.close();
-    std::cout << "Disconnected" << std::endl;
+    delete static_cast<Connection *>(ws.getUserData());
+    ws.setUserData(NULL);
+    Log(LOG_INFO, "Disconnected");
   });
 
   int port = 4567;
   if (h.listen(port)) {
-    std::cout << "Listening to port " << port << std::endl;
+    Log(LOG_INFO, "Listening to port {}", port);
   } else {
     std::cerr << "Failed to listen to port" << std::endl;
     return -1;
   }
+  if (shm.segment != NULL)
+  {
+    std::thread(ServeShm, shm.segment, &session, &recorder).detach();
+  }
   h.run();
+  FlushLog();
 }
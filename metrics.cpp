@@ -0,0 +1,196 @@
+#include "metrics.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+// Counters of one thread, on their own cache lines. A block is only written
+// by its thread and outlives it, so the counts of finished threads remain.
+struct alignas(64) ThreadCounters {
+  std::atomic<uint64_t> values[N_COUNTERS];
+};
+
+// The registry is built on first use, so it exists before any allocation
+// of the static initialization is counted.
+std::mutex &RegistryMutex()
+{
+  static std::mutex *mutex = new std::mutex();
+  return *mutex;
+}
+
+std::vector<ThreadCounters *> &Registry()
+{
+  static std::vector<ThreadCounters *> *registry = new std::vector<ThreadCounters *>();
+  return *registry;
+}
+
+thread_local ThreadCounters *thread_counters = NULL;
+// Set while the block of this thread is being registered, whose
+// allocations are not counted.
+thread_local bool registering = false;
+
+ThreadCounters *Counters()
+{
+  if (thread_counters == NULL && !registering)
+  {
+    registering = true;
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(ThreadCounters)) == 0)
+    {
+      ThreadCounters *block = new (memory) ThreadCounters();
+      for (size_t i=0; i<N_COUNTERS; i++) { block->values[i].store(0); }
+      std::lock_guard<std::mutex> lock(RegistryMutex());
+      Registry().push_back(block);
+      thread_counters = block;
+    }
+    registering = false;
+  }
+  return thread_counters;
+}
+
+std::atomic<uint64_t> gauges[N_GAUGES];
+
+const char *counter_names[N_COUNTERS][2] = {
+  {"mpc_messages_received_total", "Websocket messages received."},
+  {"mpc_messages_sent_total", "Websocket messages sent."},
+  {"mpc_solves_total", "MPC solves."},
+  {"mpc_solve_failures_total", "MPC solves that did not converge."},
+  {"mpc_stale_frames_dropped_total", "Telemetry frames dropped as out of date."},
+  {"mpc_speculative_hits_total", "Cycles answered with the solve for the predicted telemetry."},
+  {"mpc_speculative_misses_total", "Predicted telemetry off, its solve used as warm start."},
+  {"mpc_ipopt_iterations_total", "Ipopt iterations."},
+  {"mpc_ipopt_restorations_total", "Entries into the Ipopt restoration phase."},
+  {"mpc_ipopt_eval_nanoseconds_total", "Time spent evaluating the NLP and its derivatives."},
+  {"mpc_ipopt_internal_nanoseconds_total", "Time spent inside Ipopt, mostly linear algebra."},
+  {"mpc_ipopt_linear_solver_nanoseconds_total", "Time spent in the linear solver of Ipopt."},
+  {"mpc_ipopt_tape_nanoseconds_total", "Time spent recording the CppAD tape."},
+  {"mpc_allocations_total", "Calls of operator new."},
+  {"mpc_allocated_bytes_total", "Bytes requested from operator new."},
+};
+
+const char *gauge_names[N_GAUGES][2] = {
+  {"mpc_latency_estimate_seconds", "Latency the last plan was made for."},
+  {"mpc_horizon_states", "Planned states of the last solve."},
+  {"mpc_ipopt_last_iterations", "Ipopt iterations of the last solve."},
+  {"mpc_constraint_violation", "Constraint violation at the end of the last solve."},
+};
+
+// Upper bounds of the buckets of the exported histograms, in seconds.
+const double histogram_bounds[] = {
+  0.00001, 0.0001, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1
+};
+
+}  // namespace
+
+void Count(Counter counter, uint64_t n)
+{
+  ThreadCounters *block = Counters();
+  if (block == NULL) { return; }
+  // Only this thread writes the block, so a load and a store suffice.
+  std::atomic<uint64_t> &value = block->values[counter];
+  value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+uint64_t CounterTotal(Counter counter)
+{
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  uint64_t total = 0;
+  for (ThreadCounters *block : Registry())
+  {
+    total += block->values[counter].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void SetGauge(Gauge gauge, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  gauges[gauge].store(bits, std::memory_order_relaxed);
+}
+
+double GaugeValue(Gauge gauge)
+{
+  uint64_t bits = gauges[gauge].load(std::memory_order_relaxed);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+string PrometheusText(const LoopLatency &loop_latency)
+{
+  string text;
+  char line[256];
+  for (size_t i=0; i<N_COUNTERS; i++)
+  {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+             counter_names[i][0], counter_names[i][1], counter_names[i][0],
+             counter_names[i][0], (unsigned long long)CounterTotal((Counter)i));
+    text += line;
+  }
+  snprintf(line, sizeof(line),
+           "# HELP mpc_deadline_misses_total Cycles longer than the control period.\n"
+           "# TYPE mpc_deadline_misses_total counter\nmpc_deadline_misses_total %llu\n",
+           (unsigned long long)loop_latency.DeadlineMisses());
+  text += line;
+  for (size_t i=0; i<N_GAUGES; i++)
+  {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %.9g\n",
+             gauge_names[i][0], gauge_names[i][1], gauge_names[i][0],
+             gauge_names[i][0], GaugeValue((Gauge)i));
+    text += line;
+  }
+  text += "# HELP mpc_stage_duration_seconds Time spent in each stage of the control loop.\n"
+          "# TYPE mpc_stage_duration_seconds histogram\n";
+  for (size_t i=0; i<LoopLatency::N_STAGES; i++)
+  {
+    LoopLatency::Stage stage = (LoopLatency::Stage)i;
+    const LatencyHistogram &h = loop_latency.Histogram(stage);
+    const char *name = LoopLatency::StageName(stage);
+    for (double bound : histogram_bounds)
+    {
+      snprintf(line, sizeof(line),
+               "mpc_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n", name,
+               bound, (unsigned long long)h.CountBelow(bound));
+      text += line;
+    }
+    snprintf(line, sizeof(line),
+             "mpc_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n"
+             "mpc_stage_duration_seconds_sum{stage=\"%s\"} %.9g\n"
+             "mpc_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+             name, (unsigned long long)h.Count(), name, h.Sum(), name,
+             (unsigned long long)h.Count());
+    text += line;
+  }
+  return text;
+}
+
+// Count the allocations of the whole process.
+void *operator new(size_t size)
+{
+  Count(ALLOCATIONS);
+  Count(ALLOCATED_BYTES, size);
+  void *p = malloc(size > 0 ? size : 1);
+  if (p == NULL) { throw std::bad_alloc(); }
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
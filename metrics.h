@@ -0,0 +1,59 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include "latency_histogram.h"
+
+using namespace std;
+
+// Process wide counters of the controller. Each thread counts into its own
+// block with relaxed atomic increments, no locks and no shared cache lines,
+// and the blocks are summed when the metrics are scraped.
+enum Counter {
+  MESSAGES_RECEIVED,
+  MESSAGES_SENT,
+  SOLVES,
+  SOLVE_FAILURES,
+  STALE_FRAMES,
+  // Cycles answered with the solve for the predicted telemetry, and the
+  // predictions that were off, see ControlSession::Speculate.
+  SPECULATIVE_HITS,
+  SPECULATIVE_MISSES,
+  // Ipopt iterations, entries into its restoration phase, and the time spent
+  // evaluating the cost and constraints and their derivatives versus the
+  // rest of the solve, of which the linear solver's part, and the time spent
+  // recording the CppAD tape before it, see ipopt_stats.h.
+  IPOPT_ITERATIONS,
+  IPOPT_RESTORATIONS,
+  IPOPT_EVAL_NANOSECONDS,
+  IPOPT_INTERNAL_NANOSECONDS,
+  IPOPT_LINEAR_SOLVER_NANOSECONDS,
+  IPOPT_TAPE_NANOSECONDS,
+  // Calls of operator new and their bytes, counted when metrics.cpp is
+  // linked in, which replaces the global operator new.
+  ALLOCATIONS,
+  ALLOCATED_BYTES,
+  N_COUNTERS
+};
+
+// Last values of the controller, readable from any thread.
+enum Gauge {
+  LATENCY_ESTIMATE,
+  HORIZON_STATES,
+  IPOPT_LAST_ITERATIONS,
+  CONSTRAINT_VIOLATION,
+  N_GAUGES
+};
+
+void Count(Counter counter, uint64_t n = 1);
+uint64_t CounterTotal(Counter counter);
+
+void SetGauge(Gauge gauge, double value);
+double GaugeValue(Gauge gauge);
+
+// All counters, gauges and the latency histograms of the loop in the
+// Prometheus text exposition format.
+string PrometheusText(const LoopLatency &loop_latency);
+
+#endif /* METRICS_H */
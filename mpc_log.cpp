@@ -0,0 +1,91 @@
+// Inspect a telemetry log recorded with `mpc --record session.log`.
+//
+// The log is mapped in memory and its records are read in place. By default
+// this prints a summary: the number of telemetry messages and steer
+// replies, the duration of the session and the time from each telemetry
+// message to its reply. With --dump every record is printed as one CSV line.
+//
+// Usage:
+//   mpc_log session.log [--dump]
+//
+// Build it next to the controller, e.g.
+//   g++ -O2 -std=c++11 mpc_log.cpp telemetry_log.cpp -o mpc_log
+#include <math.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "telemetry_log.h"
+
+void dump(const TelemetryLog &log)
+{
+  printf("kind,time_s,sim_time,x,y,psi,speed,steering_angle,throttle,n_points\n");
+  for (const LogRecord &record : log)
+  {
+    printf("%s,%.9f,%.15g,%.15g,%.15g,%.15g,%.15g,%.15g,%.15g,%u\n",
+           record.kind == LOG_TELEMETRY ? "telemetry" : "steer", record.time_ns * 1e-9,
+           record.sim_time, record.x, record.y, record.psi, record.speed,
+           record.steering_angle, record.throttle, record.n_points);
+  }
+}
+
+void summary(const TelemetryLog &log)
+{
+  size_t n_telemetry = 0;
+  size_t n_steer = 0;
+  // Time from a telemetry message to the next steer reply.
+  double response_total = 0;
+  double response_max = 0;
+  size_t n_response = 0;
+  int64_t pending = -1;
+  for (const LogRecord &record : log)
+  {
+    if (record.kind == LOG_TELEMETRY)
+    {
+      n_telemetry++;
+      pending = record.time_ns;
+    }
+    else if (record.kind == LOG_STEER)
+    {
+      n_steer++;
+      if (pending >= 0)
+      {
+        double response = (record.time_ns - pending) * 1e-9;
+        response_total += response;
+        response_max = fmax(response_max, response);
+        n_response++;
+        pending = -1;
+      }
+    }
+  }
+  double duration = log.Size() > 0 ? (log[log.Size() - 1].time_ns - log[0].time_ns) * 1e-9 : 0;
+  printf("records:    %zu (%zu telemetry, %zu steer)\n", log.Size(), n_telemetry, n_steer);
+  printf("duration:   %.3f s\n", duration);
+  if (duration > 0)
+  {
+    printf("rate:       %.2f telemetry/s\n", n_telemetry / duration);
+  }
+  if (n_response > 0)
+  {
+    printf("response:   mean %.3f ms, max %.3f ms\n", 1000 * response_total / n_response,
+           1000 * response_max);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s session.log [--dump]\n", argv[0]);
+    return 1;
+  }
+  TelemetryLog log;
+  std::string error;
+  if (!log.Open(argv[1], error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  if (argc > 2 && strcmp(argv[2], "--dump") == 0) { dump(log); }
+  else { summary(log); }
+  return 0;
+}
@@ -0,0 +1,226 @@
+// Replay a telemetry log through the controller as fast as possible.
+//
+// Every telemetry message of a log recorded with `mpc --record` goes
+// through the same path as in main.cpp, the waypoint transform, the
+// polynomial fit, the latency estimate and MPC::Solve, with no socket and
+// no sleep. The latency is estimated from the recorded receive times, or
+// from the simulated time when the log has one. This reports
+//  - the throughput in solves per second,
+//  - the distribution of the time spent in each stage,
+//  - how far the actuators differ from the steer replies in the log.
+//
+// With --threads n the log is cut into n contiguous shards, each replayed
+// by its own controller in its own thread. A shard starts without a warm
+// start, so the actuators right after a cut may differ from the log.
+//
+// Usage:
+//   mpc_replay session.log [--threads n] [--repeat n] [--weights weights.json]
+//              [--trace trace.json] [--perf 1]
+//
+// --trace writes the timeline of the replay threads, see trace.h. --perf 1
+// adds the hardware counters of the polynomial fit, the NLP evaluations and
+// Ipopt per call, see perf_counters.h.
+//
+// Build it next to the controller, e.g.
+//   g++ -O2 -std=c++11 -pthread mpc_replay.cpp telemetry_log.cpp controller.cpp
+//       cppad_threads.cpp adaptive_mpc.cpp MPC.cpp lqr.cpp cost_weights.cpp trace.cpp
+//       perf_counters.cpp logger.cpp
+//       -lipopt -o mpc_replay
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "controller.h"
+#include "cost_weights.h"
+#include "cppad_threads.h"
+#include "perf_counters.h"
+#include "telemetry_log.h"
+#include "trace.h"
+
+// Steering angle of a steer command of 1, see main.cpp.
+const double max_steer = 25 * M_PI / 180;
+// Actuator difference above which a reply counts as diverged.
+const double divergence_tol = 1e-3;
+
+// Results of replaying a range of the log.
+struct ReplayStats {
+  vector<double> transform;
+  vector<double> fit;
+  vector<double> solve;
+  vector<double> cycle;
+  size_t n_compared;
+  size_t n_diverged;
+  double max_steering_diff;
+  double max_throttle_diff;
+};
+
+// Replay the telemetry records in [first, last). The steer reply recorded
+// after each telemetry message is compared with the replayed actuators.
+void Replay(const TelemetryLog &log, size_t first, size_t last, const CostWeights &weights,
+            ReplayStats &stats)
+{
+  Controller controller;
+  controller.verbose = false;
+  controller.mpc.SetWeights(weights);
+  stats.n_compared = 0;
+  stats.n_diverged = 0;
+  stats.max_steering_diff = 0;
+  stats.max_throttle_diff = 0;
+  const LogRecord *previous = NULL;
+  for (size_t i=first; i<last; i++)
+  {
+    const LogRecord &record = log[i];
+    if (record.kind != LOG_TELEMETRY) { continue; }
+    double elapsed = 0;
+    if (previous != NULL)
+    {
+      elapsed = isnan(record.sim_time) ? (record.time_ns - previous->time_ns) * 1e-9
+                                       : record.sim_time - previous->sim_time;
+    }
+    previous = &record;
+
+    auto start = std::chrono::steady_clock::now();
+    ControlOutput out = controller.Step(RecordTelemetry(record), elapsed);
+    std::chrono::duration<double> cycle = std::chrono::steady_clock::now() - start;
+    stats.transform.push_back(out.transform_time);
+    stats.fit.push_back(out.fit_time);
+    stats.solve.push_back(out.solve_time);
+    stats.cycle.push_back(cycle.count());
+
+    // The reply to this message, if it was recorded.
+    if (i + 1 < log.Size() && log[i + 1].kind == LOG_STEER)
+    {
+      double steering_diff = fabs(out.pred_info[0] / max_steer - log[i + 1].steering_angle);
+      double throttle_diff = fabs(out.pred_info[1] - log[i + 1].throttle);
+      stats.max_steering_diff = max(stats.max_steering_diff, steering_diff);
+      stats.max_throttle_diff = max(stats.max_throttle_diff, throttle_diff);
+      stats.n_compared++;
+      if (steering_diff > divergence_tol || throttle_diff > divergence_tol)
+      {
+        stats.n_diverged++;
+      }
+    }
+  }
+}
+
+void PrintDistribution(const char *name, vector<double> times)
+{
+  if (times.empty()) { return; }
+  sort(times.begin(), times.end());
+  double sum = 0;
+  for (double t : times) { sum += t; }
+  size_t n = times.size();
+  printf("%-10s mean %9.3f  p50 %9.3f  p90 %9.3f  p99 %9.3f  max %9.3f ms\n", name,
+         1000 * sum / n, 1000 * times[n / 2], 1000 * times[n * 9 / 10],
+         1000 * times[n * 99 / 100], 1000 * times[n - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr,
+            "usage: %s session.log [--threads n] [--repeat n] [--weights file] [--trace file]"
+            " [--perf 1]\n",
+            argv[0]);
+    return 1;
+  }
+  size_t n_threads = 1;
+  size_t repeat = 1;
+  CostWeights weights;
+  string trace_path;
+  for (int i=2; i + 1<argc; i+=2)
+  {
+    if (strcmp(argv[i], "--threads") == 0) { n_threads = max(1, atoi(argv[i + 1])); }
+    else if (strcmp(argv[i], "--repeat") == 0) { repeat = max(1, atoi(argv[i + 1])); }
+    else if (strcmp(argv[i], "--weights") == 0)
+    {
+      string error;
+      if (!LoadWeights(argv[i + 1], weights, error))
+      {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--trace") == 0) { trace_path = argv[i + 1]; }
+    else if (strcmp(argv[i], "--perf") == 0 && atoi(argv[i + 1]) != 0)
+    {
+      if (!EnablePerfStages()) { fprintf(stderr, "perf_event_open is not available\n"); }
+    }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  TelemetryLog log;
+  string error;
+  if (!log.Open(argv[1], error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  SetupCppADThreads(n_threads);
+  SetTraceThreadName("replay");
+  if (trace_path != "") { StartTrace(); }
+  vector<ReplayStats> shards(n_threads * repeat);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t r=0; r<repeat; r++)
+  {
+    vector<std::thread> workers;
+    SetCppADParallel(n_threads > 1);
+    for (size_t k=0; k<n_threads; k++)
+    {
+      size_t first = log.Size() * k / n_threads;
+      size_t last = log.Size() * (k + 1) / n_threads;
+      ReplayStats &stats = shards[r * n_threads + k];
+      if (n_threads == 1)
+      {
+        Replay(log, first, last, weights, stats);
+        continue;
+      }
+      workers.push_back(std::thread([&log, first, last, &weights, &stats, k]() {
+        SetCppADThread(k + 1);
+        SetTraceThreadName("replay");
+        Replay(log, first, last, weights, stats);
+      }));
+    }
+    for (std::thread &worker : workers) { worker.join(); }
+    SetCppADParallel(false);
+  }
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  if (trace_path != "" && !WriteTrace(trace_path, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+  }
+
+  ReplayStats total = {};
+  for (const ReplayStats &stats : shards)
+  {
+    total.transform.insert(total.transform.end(), stats.transform.begin(), stats.transform.end());
+    total.fit.insert(total.fit.end(), stats.fit.begin(), stats.fit.end());
+    total.solve.insert(total.solve.end(), stats.solve.begin(), stats.solve.end());
+    total.cycle.insert(total.cycle.end(), stats.cycle.begin(), stats.cycle.end());
+    total.n_compared += stats.n_compared;
+    total.n_diverged += stats.n_diverged;
+    total.max_steering_diff = max(total.max_steering_diff, stats.max_steering_diff);
+    total.max_throttle_diff = max(total.max_throttle_diff, stats.max_throttle_diff);
+  }
+  printf("%zu solves in %.3f s on %zu threads: %.1f solves/s\n", total.solve.size(),
+         wall.count(), n_threads, total.solve.size() / wall.count());
+  PrintDistribution("transform", total.transform);
+  PrintDistribution("fit", total.fit);
+  PrintDistribution("solve", total.solve);
+  PrintDistribution("cycle", total.cycle);
+  printf("diverged:  %zu of %zu replies (tolerance %g), max steering diff %.6f, "
+         "max throttle diff %.6f\n", total.n_diverged, total.n_compared, divergence_tol,
+         total.max_steering_diff, total.max_throttle_diff);
+  if (PerfStagesEnabled()) { printf("%s", PerfReport().c_str()); }
+  return 0;
+}
@@ -0,0 +1,206 @@
+// Headless stand-in for the simulator.
+//
+// Connects to the controller on its websocket port like the simulator does,
+// sends 42["telemetry",{...}] messages generated by the kinematic track
+// simulator (track_sim.h) and applies the 42["steer",{...}] replies. Besides
+// the fields of the simulator, every telemetry message carries the
+// simulated time in "time". The controller then takes the latency from
+// that clock and does not sleep, so the loop runs as fast as the controller
+// answers instead of in real time.
+//
+// Each exchange advances the simulated time by the actuation latency plus
+// the time the controller took to answer, and the steer command takes
+// effect at the end of it, when the next telemetry is sent. Nothing is
+// drawn, so it asks the controller for replies without the visualization
+// arrays (?viz=off, see ReplyOptions).
+//
+// Usage:
+//   mpc_sim [--track waypoints.csv] [--host 127.0.0.1] [--port 4567]
+//           [--latency 0.1] [--laps 1] [--time-limit 600] [--speed 10]
+//           [--format text|msgpack|cbor|packed] [--shm name]
+// Without a track file it drives a synthetic track. It stops after the
+// laps, when the car leaves the track or at the time limit, and prints a
+// summary. --format exchanges binary frames with the controller instead of
+// the text frames of the simulator, see wire_format.h. --shm exchanges
+// fixed-layout records with a controller on the same host through its
+// shared memory segment (mpc --shm name) instead, see shm_transport.h.
+//
+// Build it next to the controller, e.g.
+//   g++ -O2 -std=c++11 -pthread mpc_sim.cpp track_sim.cpp controller.cpp adaptive_mpc.cpp
+//       MPC.cpp lqr.cpp cost_weights.cpp trace.cpp perf_counters.cpp logger.cpp wire_format.cpp
+//       shm_transport.cpp -lipopt -luWS -lssl -lcrypto -lz -lrt -o mpc_sim
+#include <math.h>
+#include <uWS/uWS.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "shm_transport.h"
+#include "track_sim.h"
+#include "wire_format.h"
+
+// Largest distance from the track before the car counts as off the track.
+const double max_offset = 3.0;
+
+int main(int argc, char *argv[])
+{
+  string track_path;
+  string host = "127.0.0.1";
+  int port = 4567;
+  double latency = 0.1;
+  double laps = 1;
+  double time_limit = 600;
+  double speed = 10;
+  WireFormat format = WIRE_TEXT;
+  string shm_name;
+  for (int i=1; i + 1<argc; i+=2)
+  {
+    if (strcmp(argv[i], "--track") == 0) { track_path = argv[i + 1]; }
+    else if (strcmp(argv[i], "--host") == 0) { host = argv[i + 1]; }
+    else if (strcmp(argv[i], "--port") == 0) { port = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--latency") == 0) { latency = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--laps") == 0) { laps = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--time-limit") == 0) { time_limit = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--speed") == 0) { speed = atof(argv[i + 1]); }
+    else if (strcmp(argv[i], "--format") == 0 && ParseWireFormat(argv[i + 1], format)) {}
+    else if (strcmp(argv[i], "--shm") == 0) { shm_name = argv[i + 1]; }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  Track track;
+  if (track_path != "")
+  {
+    string error;
+    if (!track.Load(track_path, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  else
+  {
+    track = Track::Synthetic(150, 0.15, 3, 20);
+  }
+  SimConfig config;
+  TrackSim sim(track, config);
+  sim.Reset(0, speed);
+
+  // Statistics of the run.
+  size_t cycles = 0;
+  double max_cte = 0;
+  double response_total = 0;
+  double response_max = 0;
+  const char *outcome = "disconnected";
+  std::chrono::steady_clock::time_point sent;
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+  // Apply a steer command, false when the run is over.
+  auto apply = [&](double steering, double throttle) {
+    std::chrono::duration<double> response = std::chrono::steady_clock::now() - sent;
+    response_total += response.count();
+    response_max = fmax(response_max, response.count());
+    cycles++;
+
+    // The command reaches the car after the answer and the actuation latency.
+    double elapsed = response.count() + latency;
+    sim.Command(steering, throttle, elapsed);
+    sim.Advance(elapsed);
+    max_cte = fmax(max_cte, fabs(sim.Offset()));
+
+    if (fabs(sim.Offset()) > max_offset) { outcome = "off the track"; }
+    else if (sim.Distance() >= laps * track.Length()) { outcome = "finished"; }
+    else if (sim.Time() >= time_limit) { outcome = "time limit"; }
+    else { return true; }
+    return false;
+  };
+  auto summary = [&]() {
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - started;
+    printf("%s after %.2f s simulated in %.2f s: %.0f m, %zu cycles, "
+           "max cte %.2f m, response mean %.2f ms max %.2f ms\n",
+           outcome, sim.Time(), wall.count(), sim.Distance(), cycles, max_cte,
+           1000 * response_total / fmax(1, cycles), 1000 * response_max);
+  };
+
+  if (shm_name != "")
+  {
+    ShmChannel channel;
+    string error;
+    if (!channel.Attach(shm_name, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    printf("Attached, track of %.0f m\n", track.Length());
+    started = std::chrono::steady_clock::now();
+    ShmSegment &segment = *channel.segment;
+    ShmTelemetry record;
+    ShmCommand command;
+    do
+    {
+      if (!ToShm(sim.Observe(), sim.Time(), record))
+      {
+        fprintf(stderr, "more than %zu waypoints\n", shm_max_points);
+        return 1;
+      }
+      record.first = cycles == 0;
+      sent = std::chrono::steady_clock::now();
+      segment.telemetry.Push(record);
+      if (!segment.commands.Pop(command, 5.0))
+      {
+        outcome = "controller not answering";
+        break;
+      }
+    } while (apply(command.steering_angle, command.throttle));
+    summary();
+    return strcmp(outcome, "finished") == 0 ? 0 : 1;
+  }
+
+  uWS::Hub h;
+  uWS::OpCode opcode = format == WIRE_TEXT ? uWS::OpCode::TEXT : uWS::OpCode::BINARY;
+  vector<char> msg;
+
+  h.onConnection([&](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    printf("Connected, track of %.0f m\n", track.Length());
+    started = std::chrono::steady_clock::now();
+    EncodeTelemetry(format, sim.Observe(), sim.Time(), msg);
+    sent = std::chrono::steady_clock::now();
+    ws.send(msg.data(), msg.size(), opcode);
+  });
+
+  h.onMessage([&](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length,
+                  uWS::OpCode opCode) {
+    double steering, throttle;
+    string error;
+    if (!DecodeSteer(format, data, length, steering, throttle, error)) { return; }
+    if (apply(steering, throttle))
+    {
+      EncodeTelemetry(format, sim.Observe(), sim.Time(), msg);
+      sent = std::chrono::steady_clock::now();
+      ws.send(msg.data(), msg.size(), opcode);
+      return;
+    }
+    ws.close();
+  });
+
+  h.onDisconnection([&](uWS::WebSocket<uWS::CLIENT> ws, int code, char *message,
+                        size_t length) {
+    summary();
+  });
+
+  h.onError([&](void *user) {
+    fprintf(stderr, "Failed to connect to %s:%d\n", host.c_str(), port);
+    exit(1);
+  });
+
+  const char *format_names[] = {"text", "msgpack", "cbor", "packed"};
+  h.connect("ws://" + host + ":" + std::to_string(port) + "/?viz=off&format=" +
+            format_names[format], nullptr);
+  h.run();
+  return strcmp(outcome, "finished") == 0 ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Closed-loop autotuner of the cost weights.
+//
+// Every candidate set of weights drives one lap of a track in the kinematic
+// track simulator (track_sim.h), with the same controller as main.cpp. The
+// candidates of a generation run in parallel, one controller per worker
+// thread, and are searched with CMA-ES over the logarithm of the weights
+// and of the reference speed. A lap is scored by
+//   lap time + 10 s per meter of max |cte|,
+// and a lap that leaves the track or runs out of time by 1000 s plus 1000 s
+// times the fraction of the lap left. The closed loop runs on a fixed cycle
+// time rather than the measured solve time, which depends on the other
+// workers, so that a score only depends on the weights. The solve time of
+// the baseline and of the best weights is measured afterwards, alone.
+//
+// Usage:
+//   mpc_tune [--track waypoints.csv] [--threads n] [--generations g]
+//            [--population p] [--time-limit s] [--out weights.json]
+// Without a track file it drives a synthetic track with bends of different
+// sharpness. The best weights are printed and written to --out, in the
+// format of weights.json.
+//
+// Ipopt runs in several threads at once, so it needs a thread-safe linear
+// solver, e.g. MUMPS from Ipopt 3.14 on, which serializes its calls.
+//
+// Build it next to the controller, e.g.
+//   g++ -O2 -std=c++11 -pthread mpc_tune.cpp cmaes.cpp controller.cpp track_sim.cpp
+//       cppad_threads.cpp adaptive_mpc.cpp MPC.cpp lqr.cpp cost_weights.cpp trace.cpp
+//       perf_counters.cpp logger.cpp -lipopt -o mpc_tune
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Eigen-3.3/Eigen/Core"
+#include "cmaes.h"
+#include "controller.h"
+#include "cppad_threads.h"
+#include "cost_weights.h"
+#include "track_sim.h"
+
+// Actuation latency of the simulator setup, see main.cpp.
+const double latency = 0.1;
+// Time of a cycle of the closed loop besides the latency, about a solve.
+const double solve_allowance = 0.02;
+// Largest distance from the track before the car counts as off the track.
+const double max_offset = 3.0;
+// Lower and upper bound of the search in log space, a factor of e^3.
+const double log_bound = 3.0;
+
+struct LapResult {
+  bool finished;
+  // Time of the lap, or of the attempt, in seconds.
+  double lap_time;
+  // Fraction of the lap driven.
+  double fraction;
+  // Largest distance from the track in meters.
+  double max_cte;
+  // Mean time of a control cycle in milliseconds, only meaningful when
+  // nothing else runs at the same time.
+  double mean_solve;
+};
+
+double Score(const LapResult &lap)
+{
+  if (!lap.finished) { return 1000 + 1000 * (1 - max(0.0, lap.fraction)); }
+  return lap.lap_time + 10 * lap.max_cte;
+}
+
+// Drive one lap with `weights`. Every cycle takes the latency plus
+// solve_allowance, whatever the solve took.
+LapResult DriveLap(const Track &track, const CostWeights &weights, double time_limit)
+{
+  Controller controller;
+  controller.verbose = false;
+  controller.mpc.SetWeights(weights);
+  TrackSim sim(track, SimConfig());
+  sim.Reset(0, 10);
+  LapResult lap = {false, 0, 0, 0, 0};
+  double elapsed = latency + solve_allowance;
+  size_t cycles = 0;
+  double solve_total = 0;
+  while (sim.Time() < time_limit)
+  {
+    Telemetry telemetry = sim.Observe();
+    auto start = std::chrono::steady_clock::now();
+    ControlOutput out = controller.Step(telemetry, elapsed);
+    std::chrono::duration<double> solve = std::chrono::steady_clock::now() - start;
+    // Same as the steering and throttle values sent by main.cpp.
+    double steering = out.pred_info[0] / SimConfig().max_steer;
+    double throttle = out.pred_info[1];
+    sim.Command(steering, throttle, elapsed);
+    sim.Advance(elapsed);
+    cycles++;
+    solve_total += solve.count();
+    lap.max_cte = max(lap.max_cte, fabs(sim.Offset()));
+    if (lap.max_cte > max_offset) { break; }
+    if (sim.Distance() >= track.Length())
+    {
+      lap.finished = true;
+      break;
+    }
+  }
+  lap.lap_time = sim.Time();
+  lap.fraction = sim.Distance() / track.Length();
+  lap.mean_solve = 1000 * solve_total / max((size_t)1, cycles);
+  return lap;
+}
+
+// Weights of a point of the search space, the log of the factor applied to
+// each default weight and to the reference speed.
+CostWeights WeightsAt(const Eigen::VectorXd &x)
+{
+  CostWeights w;
+  double *fields[] = {&w.cte, &w.epsi, &w.v, &w.delta, &w.a, &w.ddelta, &w.da,
+                      &w.dcte, &w.depsi, &w.curvature, &w.ref_v};
+  for (size_t i=0; i<sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    *fields[i] *= exp(max(-log_bound, min(log_bound, x[i])));
+  }
+  return w;
+}
+
+int main(int argc, char *argv[])
+{
+  string track_path;
+  string out_path;
+  size_t n_threads = std::thread::hardware_concurrency();
+  size_t generations = 30;
+  size_t population = 0;
+  double time_limit = 120;
+  for (int i=1; i + 1<argc; i+=2)
+  {
+    if (strcmp(argv[i], "--track") == 0) { track_path = argv[i + 1]; }
+    else if (strcmp(argv[i], "--out") == 0) { out_path = argv[i + 1]; }
+    else if (strcmp(argv[i], "--threads") == 0) { n_threads = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--generations") == 0) { generations = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--population") == 0) { population = atoi(argv[i + 1]); }
+    else if (strcmp(argv[i], "--time-limit") == 0) { time_limit = atof(argv[i + 1]); }
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+  n_threads = max((size_t)1, n_threads);
+
+  Track track;
+  if (track_path != "")
+  {
+    string error;
+    if (!track.Load(track_path, error))
+    {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+  }
+  else
+  {
+    track = Track::Synthetic(150, 0.15, 3, 20);
+  }
+  printf("track: %zu waypoints, %.0f m\n", track.Size(), track.Length());
+
+  SetupCppADThreads(n_threads);
+
+  // Start at the weights of the README.
+  CMAES es(Eigen::VectorXd::Zero(11), 0.5, population);
+  LapResult baseline = DriveLap(track, CostWeights(), time_limit);
+  printf("baseline: score %.2f, lap %.2f s, max cte %.2f m, solve %.2f ms\n",
+         Score(baseline), baseline.lap_time, baseline.max_cte, baseline.mean_solve);
+
+  for (size_t g=0; g<generations; g++)
+  {
+    const vector<Eigen::VectorXd> &candidates = es.Ask();
+    vector<LapResult> laps(candidates.size());
+    std::atomic<size_t> next(0);
+    SetCppADParallel(true);
+    vector<std::thread> workers;
+    for (size_t k=0; k<n_threads; k++)
+    {
+      workers.push_back(std::thread([&, k]() {
+        SetCppADThread(k + 1);
+        for (size_t i = next++; i < candidates.size(); i = next++)
+        {
+          laps[i] = DriveLap(track, WeightsAt(candidates[i]), time_limit);
+        }
+      }));
+    }
+    for (std::thread &worker : workers) { worker.join(); }
+    SetCppADParallel(false);
+
+    vector<double> scores(laps.size());
+    size_t best = 0;
+    for (size_t i=0; i<laps.size(); i++)
+    {
+      scores[i] = Score(laps[i]);
+      if (scores[i] < scores[best]) { best = i; }
+    }
+    es.Tell(scores);
+    printf("generation %zu: score %.2f, lap %.2f s, max cte %.2f m, sigma %.3f\n",
+           g, scores[best], laps[best].lap_time, laps[best].max_cte, es.Sigma());
+    fflush(stdout);
+  }
+
+  LapResult final_lap = DriveLap(track, WeightsAt(es.Best()), time_limit);
+  printf("best: score %.2f, lap %.2f s, max cte %.2f m, solve %.2f ms\n",
+         Score(final_lap), final_lap.lap_time, final_lap.max_cte, final_lap.mean_solve);
+  string best = WeightsToJson(WeightsAt(es.Best()));
+  printf("%s\n", best.c_str());
+  if (out_path != "")
+  {
+    std::ofstream out(out_path.c_str());
+    out << best << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "perf_counters.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace perf_detail {
+std::atomic<bool> enabled(false);
+}
+
+namespace {
+
+#ifdef __linux__
+const uint64_t events[4] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+int OpenEvent(uint64_t config, int group)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+// Totals of the stages measured by one thread, written by that thread only.
+// Blocks outlive their thread.
+struct alignas(64) ThreadStages {
+  std::atomic<uint64_t> values[N_PERF_STAGES][5];
+};
+
+std::mutex registry_mutex;
+std::vector<ThreadStages *> registry;
+
+thread_local PerfCounters *thread_counters = NULL;
+thread_local ThreadStages *thread_stages = NULL;
+
+const char *stage_names[N_PERF_STAGES] = {
+  "polyfit", "nlp_eval", "ipopt", "json_parse", "json_dump"
+};
+
+void PrintLine(string &text, const char *name, const PerfSample &s, uint64_t calls)
+{
+  char line[256];
+  double n = calls > 0 ? calls : 1;
+  double kinstr = s.instructions > 0 ? s.instructions / 1000.0 : 1;
+  snprintf(line, sizeof(line),
+           "%-15s %8llu calls %12.0f cycles %12.0f instr  IPC %5.2f"
+           "  cache miss/kinstr %6.2f  branch miss/kinstr %6.2f\n",
+           name, (unsigned long long)calls, s.cycles / n, s.instructions / n,
+           s.cycles > 0 ? (double)s.instructions / s.cycles : 0.0, s.cache_misses / kinstr,
+           s.branch_misses / kinstr);
+  text += line;
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters()
+{
+  for (size_t i=0; i<4; i++) { fds[i] = -1; }
+#ifdef __linux__
+  fds[0] = OpenEvent(events[0], -1);
+  if (fds[0] < 0) { return; }
+  for (size_t i=1; i<4; i++) { fds[i] = OpenEvent(events[i], fds[0]); }
+  ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+  for (size_t i=0; i<4; i++)
+  {
+    if (fds[i] >= 0) { close(fds[i]); }
+  }
+#endif
+}
+
+PerfSample PerfCounters::Read() const
+{
+  PerfSample sample;
+#ifdef __linux__
+  if (!Ok()) { return sample; }
+  // The number of events, the time the group was enabled and the time it
+  // was counting, then the values in the order the events were opened.
+  uint64_t data[7] = {0};
+  if (read(fds[0], data, sizeof(data)) < (ssize_t)(4 * sizeof(uint64_t))) { return sample; }
+  if (data[2] == 0) { return sample; }
+  // With more events than hardware counters the kernel multiplexes them,
+  // and the group counted only for a part of the time. Scale the counts up
+  // to the whole time as perf stat does.
+  double scale = data[1] > data[2] ? (double)data[1] / data[2] : 1.0;
+  uint64_t *counts[4] = {
+    &sample.cycles, &sample.instructions, &sample.cache_misses, &sample.branch_misses
+  };
+  size_t k = 3;
+  for (size_t i=0; i<4 && k<3+data[0]; i++)
+  {
+    if (fds[i] >= 0) { *counts[i] = (uint64_t)(data[k++] * scale); }
+  }
+#endif
+  return sample;
+}
+
+PerfSample perf_detail::ThreadSample()
+{
+  if (thread_counters == NULL)
+  {
+    thread_counters = new PerfCounters();
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(ThreadStages)) == 0)
+    {
+      ThreadStages *block = new (memory) ThreadStages();
+      for (size_t i=0; i<N_PERF_STAGES; i++)
+      {
+        for (size_t k=0; k<5; k++) { block->values[i][k].store(0); }
+      }
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      registry.push_back(block);
+      thread_stages = block;
+    }
+  }
+  return thread_counters->Read();
+}
+
+void perf_detail::Add(PerfStage stage, const PerfSample &sample)
+{
+  if (thread_stages == NULL) { return; }
+  const uint64_t counts[5] = {
+    sample.cycles, sample.instructions, sample.cache_misses, sample.branch_misses, 1
+  };
+  std::atomic<uint64_t> *values = thread_stages->values[stage];
+  for (size_t k=0; k<5; k++)
+  {
+    values[k].store(values[k].load(std::memory_order_relaxed) + counts[k],
+                    std::memory_order_relaxed);
+  }
+}
+
+bool EnablePerfStages()
+{
+  PerfCounters probe;
+  if (!probe.Ok()) { return false; }
+  perf_detail::enabled.store(true);
+  return true;
+}
+
+PerfSample PerfStageTotal(PerfStage stage)
+{
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  PerfSample total;
+  for (ThreadStages *block : registry)
+  {
+    total.cycles += block->values[stage][0].load(std::memory_order_relaxed);
+    total.instructions += block->values[stage][1].load(std::memory_order_relaxed);
+    total.cache_misses += block->values[stage][2].load(std::memory_order_relaxed);
+    total.branch_misses += block->values[stage][3].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+uint64_t PerfStageCount(PerfStage stage)
+{
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  uint64_t total = 0;
+  for (ThreadStages *block : registry)
+  {
+    total += block->values[stage][4].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+const char *PerfStageName(PerfStage stage)
+{
+  return stage_names[stage];
+}
+
+string PerfReport()
+{
+  string text;
+  for (size_t i=0; i<N_PERF_STAGES; i++)
+  {
+    PerfStage stage = (PerfStage)i;
+    uint64_t calls = PerfStageCount(stage);
+    if (calls == 0) { continue; }
+    PrintLine(text, PerfStageName(stage), PerfStageTotal(stage), calls);
+  }
+  // Ipopt without the evaluations, per solve.
+  uint64_t solves = PerfStageCount(PERF_IPOPT);
+  if (solves > 0)
+  {
+    PrintLine(text, "ipopt_internal", PerfStageTotal(PERF_IPOPT) - PerfStageTotal(PERF_NLP_EVAL),
+              solves);
+  }
+  return text;
+}
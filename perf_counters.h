@@ -0,0 +1,118 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+// Hardware performance counters of Linux perf_event_open, to tell whether a
+// stage of the loop is bound by compute, memory or branches.
+
+// Counts of the user space of one thread.
+struct PerfSample {
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cache_misses;
+  uint64_t branch_misses;
+
+  PerfSample() : cycles(0), instructions(0), cache_misses(0), branch_misses(0) {}
+  PerfSample operator-(const PerfSample &other) const
+  {
+    PerfSample d;
+    d.cycles = cycles - other.cycles;
+    d.instructions = instructions - other.instructions;
+    d.cache_misses = cache_misses - other.cache_misses;
+    d.branch_misses = branch_misses - other.branch_misses;
+    return d;
+  }
+  PerfSample &operator+=(const PerfSample &other)
+  {
+    cycles += other.cycles;
+    instructions += other.instructions;
+    cache_misses += other.cache_misses;
+    branch_misses += other.branch_misses;
+    return *this;
+  }
+};
+
+// The counters of the calling thread, counting from construction. A counter
+// the CPU or the kernel does not offer stays at 0, e.g. in a VM or with
+// kernel.perf_event_paranoid above 2. When the kernel multiplexes the group
+// with other events, the counts are scaled up to the time it was enabled.
+class PerfCounters {
+public:
+  PerfCounters();
+  virtual ~PerfCounters();
+
+  // Whether at least the cycles are counted.
+  bool Ok() const { return fds[0] >= 0; }
+  PerfSample Read() const;
+
+private:
+  // Cycles, the group leader, then the other events.
+  int fds[4];
+  PerfCounters(const PerfCounters &);
+  PerfCounters &operator=(const PerfCounters &);
+};
+
+// Stages of the loop measured with PerfScope.
+enum PerfStage {
+  // polyfit of the reference line.
+  PERF_POLYFIT,
+  // Evaluations of the cost and constraints and their derivatives on the
+  // CppAD tape, called by Ipopt.
+  PERF_NLP_EVAL,
+  // A whole Ipopt solve, including PERF_NLP_EVAL. The difference is Ipopt
+  // itself, mostly the linear solves of the search direction.
+  PERF_IPOPT,
+  PERF_JSON_PARSE,
+  PERF_JSON_DUMP,
+  N_PERF_STAGES
+};
+
+namespace perf_detail {
+extern std::atomic<bool> enabled;
+PerfSample ThreadSample();
+void Add(PerfStage stage, const PerfSample &sample);
+}
+
+// Measure the stages from now on. Returns false if perf_event_open is not
+// available, e.g. not on Linux or not permitted, and then stays off. When
+// off, a PerfScope costs one relaxed atomic load.
+bool EnablePerfStages();
+inline bool PerfStagesEnabled()
+{
+  return perf_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Add the counts of the lifetime of the object to `stage`. The counters of
+// each thread are opened by its first scope.
+class PerfScope {
+public:
+  PerfScope(PerfStage stage) : stage(stage), on(PerfStagesEnabled())
+  {
+    if (on) { start = perf_detail::ThreadSample(); }
+  }
+  ~PerfScope()
+  {
+    if (on) { perf_detail::Add(stage, perf_detail::ThreadSample() - start); }
+  }
+
+private:
+  PerfStage stage;
+  bool on;
+  PerfSample start;
+};
+
+// Totals of a stage over all threads, and the number of scopes.
+PerfSample PerfStageTotal(PerfStage stage);
+uint64_t PerfStageCount(PerfStage stage);
+const char *PerfStageName(PerfStage stage);
+
+// One line per measured stage: counts per call, instructions per cycle,
+// cache and branch misses per thousand instructions.
+string PerfReport();
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,206 @@
+#include "reply_writer.h"
+#include <errno.h>
+#include <math.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
+ReplyWriter::ReplyWriter(int precision, WireFormat format)
+  : precision(precision), format(format), buffer(4096), size(0) {}
+
+void ReplyWriter::Append(const char *text, size_t length)
+{
+  if (size + length > buffer.size()) { buffer.resize(2 * (size + length)); }
+  memcpy(buffer.data() + size, text, length);
+  size += length;
+}
+
+// As json.hpp 2.1.1 writes a double: "%.15g", with ".0" added to integers,
+// and null for NaN and infinity.
+void ReplyWriter::Number(double x)
+{
+  if (!isfinite(x))
+  {
+    Append("null", 4);
+    return;
+  }
+  if (x == 0)
+  {
+    if (signbit(x)) { Append("-0.0", 4); }
+    else { Append("0.0", 3); }
+    return;
+  }
+  char text[32];
+  int digits = precision < 1 ? 1 : precision > 17 ? 17 : precision;
+#if __cplusplus >= 201703L
+  // Same digits as printf's %.*g, without the locale and the format parsing.
+  size_t length = std::to_chars(text, text + sizeof(text), x, std::chars_format::general,
+                                digits).ptr - text;
+#else
+  size_t length = snprintf(text, sizeof(text), "%.*g", digits, x);
+#endif
+  Append(text, length);
+  if (memchr(text, '.', length) == NULL && memchr(text, 'e', length) == NULL)
+  {
+    Append(".0", 2);
+  }
+}
+
+void ReplyWriter::Array(const char *key, const Series &series)
+{
+  Append("\"", 1);
+  Append(key, strlen(key));
+  Append("\":[", 3);
+  bool first = true;
+  for (size_t i=0; i<series.leading_zeros; i++)
+  {
+    Append(first ? "0.0" : ",0.0", first ? 3 : 4);
+    first = false;
+  }
+  for (size_t i=0; i<series.n; i++)
+  {
+    if (!first) { Append(",", 1); }
+    Number(series.values[i * series.stride]);
+    first = false;
+  }
+  Append("],", 2);
+}
+
+// PackedSteer and the arrays, `series` being mpc_x, mpc_y, next_x and
+// next_y, or NULL for none.
+void ReplyWriter::Packed(double steering, double throttle, const Series *series)
+{
+  PackedSteer header;
+  memcpy(header.magic, "MPS1", 4);
+  header.n_plan = series ? series[0].leading_zeros + series[0].n : 0;
+  header.n_next = series ? series[2].leading_zeros + series[2].n : 0;
+  header.reserved = 0;
+  header.steering_angle = steering;
+  header.throttle = throttle;
+  Append(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (size_t k=0; series && k<4; k++)
+  {
+    const double zero = 0;
+    for (size_t i=0; i<series[k].leading_zeros; i++)
+    {
+      Append(reinterpret_cast<const char *>(&zero), sizeof(zero));
+    }
+    for (size_t i=0; i<series[k].n; i++)
+    {
+      Append(reinterpret_cast<const char *>(series[k].values + i * series[k].stride),
+             sizeof(double));
+    }
+  }
+}
+
+// The data object in MessagePack or CBOR, through json.hpp.
+void ReplyWriter::Object(double steering, double throttle, const Series *series)
+{
+  nlohmann::json data;
+  data["steering_angle"] = steering;
+  data["throttle"] = throttle;
+  const char *keys[4] = {"mpc_x", "mpc_y", "next_x", "next_y"};
+  for (size_t k=0; series && k<4; k++)
+  {
+    vector<double> values(series[k].leading_zeros, 0.0);
+    for (size_t i=0; i<series[k].n; i++)
+    {
+      values.push_back(series[k].values[i * series[k].stride]);
+    }
+    data[keys[k]] = values;
+  }
+  vector<uint8_t> bytes = format == WIRE_MSGPACK ? nlohmann::json::to_msgpack(data)
+                                                 : nlohmann::json::to_cbor(data);
+  Append(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+void ReplyWriter::Steer(double steering, double throttle, const Series &mpc_x,
+                        const Series &mpc_y, const Series &next_x, const Series &next_y)
+{
+  size = 0;
+  if (Binary())
+  {
+    const Series series[4] = {mpc_x, mpc_y, next_x, next_y};
+    if (format == WIRE_PACKED) { Packed(steering, throttle, series); }
+    else { Object(steering, throttle, series); }
+    return;
+  }
+  const char start[] = "42[\"steer\",{";
+  Append(start, sizeof(start) - 1);
+  Array("mpc_x", mpc_x);
+  Array("mpc_y", mpc_y);
+  Array("next_x", next_x);
+  Array("next_y", next_y);
+  const char steering_key[] = "\"steering_angle\":";
+  Append(steering_key, sizeof(steering_key) - 1);
+  Number(steering);
+  const char throttle_key[] = ",\"throttle\":";
+  Append(throttle_key, sizeof(throttle_key) - 1);
+  Number(throttle);
+  Append("}]", 2);
+}
+
+void ReplyWriter::Actuation(double steering, double throttle)
+{
+  size = 0;
+  if (format == WIRE_PACKED)
+  {
+    Packed(steering, throttle, NULL);
+    return;
+  }
+  if (Binary())
+  {
+    Object(steering, throttle, NULL);
+    return;
+  }
+  const char start[] = "42[\"steer\",{\"steering_angle\":";
+  Append(start, sizeof(start) - 1);
+  Number(steering);
+  const char throttle_key[] = ",\"throttle\":";
+  Append(throttle_key, sizeof(throttle_key) - 1);
+  Number(throttle);
+  Append("}]", 2);
+}
+
+bool ParseReplyOptions(const string &url, ReplyOptions &options, string &error)
+{
+  size_t query = url.find('?');
+  if (query == string::npos) { return true; }
+  std::istringstream pairs(url.substr(query + 1));
+  string pair;
+  while (std::getline(pairs, pair, '&'))
+  {
+    if (pair.empty()) { continue; }
+    size_t equal = pair.find('=');
+    string key = pair.substr(0, equal);
+    string value = equal == string::npos ? "" : pair.substr(equal + 1);
+    // The whole value as a decimal number, or 0, which no option takes.
+    char *end = NULL;
+    errno = 0;
+    long number = strtol(value.c_str(), &end, 10);
+    if (value.empty() || !isdigit((unsigned char)value[0]) || *end != '\0' || errno == ERANGE)
+    {
+      number = 0;
+    }
+    if (key == "viz" && (value == "on" || value == "off"))
+    {
+      options.visualization = value == "on";
+    }
+    else if (key == "viz_stride" && number >= 1) { options.stride = number; }
+    else if (key == "viz_every" && number >= 1) { options.every = number; }
+    else if (key == "viz_pad" && (value == "0" || value == "1")) { options.pad = value == "1"; }
+    else if (key == "precision" && number >= 1 && number <= 17) { options.precision = number; }
+    else if (key == "format" && ParseWireFormat(value, options.format)) {}
+    else
+    {
+      error = "invalid reply option " + pair;
+      return false;
+    }
+  }
+  return true;
+}
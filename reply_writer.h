@@ -0,0 +1,89 @@
+#ifndef REPLY_WRITER_H
+#define REPLY_WRITER_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "wire_format.h"
+
+using namespace std;
+
+// Values of one array of the reply, read in place: `n` values `stride`
+// doubles apart starting at `values`, preceded by `leading_zeros` zeros.
+struct Series {
+  const double *values;
+  size_t n;
+  size_t stride;
+  size_t leading_zeros;
+
+  Series(const double *values = NULL, size_t n = 0, size_t stride = 1, size_t leading_zeros = 0)
+    : values(values), n(n), stride(stride), leading_zeros(leading_zeros) {}
+};
+
+// What a connection wants in its steer replies. The visualization arrays
+// mpc_x, mpc_y, next_x and next_y are only drawn by the simulator, a
+// headless client needs just the actuators.
+struct ReplyOptions {
+  // Send the visualization arrays at all.
+  bool visualization;
+  // Send every `stride`-th point of the arrays, starting from the first.
+  size_t stride;
+  // Send the arrays with every `every`-th reply only, the other replies
+  // carry the actuators alone.
+  size_t every;
+  // Precede the planned points with N zeros, as the simulator has always
+  // been sent, every `stride`-th of them like the points.
+  bool pad;
+  // Significant digits of the numbers.
+  int precision;
+  // Encoding of the telemetry and the replies, see wire_format.h.
+  WireFormat format;
+
+  ReplyOptions()
+    : visualization(true), stride(1), every(1), pad(true), precision(15), format(WIRE_TEXT) {}
+};
+
+// Read the options from the query of the websocket URL, e.g. "/?viz=off"
+// or "/?viz_stride=2&viz_every=5&viz_pad=0&precision=6&format=packed".
+// Options not in the query keep their value.
+bool ParseReplyOptions(const string &url, ReplyOptions &options, string &error);
+
+// Formats the steer reply to the simulator into a buffer that is reused
+// from one reply to the next, so after the first few replies it allocates
+// nothing. With the default precision of 15 digits the output is byte for
+// byte what nlohmann::json::dump() gives for the same message. In a binary
+// format the same fields are written as wire_format.h describes.
+class ReplyWriter {
+public:
+  explicit ReplyWriter(int precision = 15, WireFormat format = WIRE_TEXT);
+
+  // 42["steer",{"mpc_x":[..],"mpc_y":[..],"next_x":[..],"next_y":[..],
+  // "steering_angle":..,"throttle":..}], the keys sorted as in json.hpp.
+  void Steer(double steering, double throttle, const Series &mpc_x, const Series &mpc_y,
+             const Series &next_x, const Series &next_y);
+
+  // 42["steer",{"steering_angle":..,"throttle":..}], without the
+  // visualization arrays.
+  void Actuation(double steering, double throttle);
+
+  // The last reply, valid until the next call.
+  const char *Data() const { return buffer.data(); }
+  size_t Size() const { return size; }
+
+  // Significant digits of the numbers of the text format, at most 17.
+  int precision;
+  WireFormat format;
+  bool Binary() const { return format != WIRE_TEXT; }
+
+private:
+  vector<char> buffer;
+  size_t size;
+
+  void Append(const char *text, size_t length);
+  void Number(double x);
+  void Array(const char *key, const Series &series);
+  void Packed(double steering, double throttle, const Series *series);
+  void Object(double steering, double throttle, const Series *series);
+};
+
+#endif /* REPLY_WRITER_H */
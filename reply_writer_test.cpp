@@ -0,0 +1,112 @@
+// Checks that ReplyWriter formats the steer reply byte for byte as the
+// controller used to with nlohmann::json::dump(), on random replies. The
+// values are drawn from several scales, with integers, zeros, negative
+// zeros and non finite values among them, and the arrays are read with
+// strides and leading zeros as the controller reads them.
+//
+// Build it next to the controller, e.g.
+//   g++ -std=c++11 reply_writer_test.cpp reply_writer.cpp wire_format.cpp -o reply_writer_test
+// and once more with -std=c++17, which formats the numbers with to_chars.
+// It exits with 1 on the first reply that differs and prints both.
+#include <math.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "reply_writer.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+double RandomValue(std::mt19937 &random)
+{
+  std::uniform_int_distribution<int> kind(0, 9);
+  std::uniform_real_distribution<double> uniform(-1, 1);
+  std::uniform_int_distribution<int> exponent(-12, 12);
+  switch (kind(random))
+  {
+  case 0: return 0.0;
+  case 1: return -0.0;
+  case 2: return floor(uniform(random) * 1000);
+  case 3: return NAN;
+  case 4: return uniform(random) > 0 ? INFINITY : -INFINITY;
+  case 5: return uniform(random) * pow(10.0, 3 * exponent(random));
+  default: return uniform(random) * pow(10.0, exponent(random));
+  }
+}
+
+// `n` values, `stride` apart, of which the controller sends every one.
+vector<double> RandomValues(std::mt19937 &random, size_t n, size_t stride)
+{
+  vector<double> values(n * stride);
+  for (double &x : values) { x = RandomValue(random); }
+  return values;
+}
+
+// The array the controller built before ReplyWriter: the leading zeros,
+// then the values.
+vector<double> Expand(const Series &series)
+{
+  vector<double> values(series.leading_zeros, 0.0);
+  for (size_t i=0; i<series.n; i++) { values.push_back(series.values[i * series.stride]); }
+  return values;
+}
+
+}  // namespace
+
+int main()
+{
+  std::mt19937 random(42);
+  std::uniform_int_distribution<size_t> length(0, 30);
+  std::uniform_int_distribution<size_t> stride(1, 3);
+  const int n_replies = 20000;
+  ReplyWriter writer;
+  for (int k=0; k<n_replies; k++)
+  {
+    double steering = RandomValue(random);
+    double throttle = RandomValue(random);
+    string expected, actual;
+    if (k % 10 == 0)
+    {
+      json message;
+      message["steering_angle"] = steering;
+      message["throttle"] = throttle;
+      expected = "42[\"steer\"," + message.dump() + "]";
+      writer.Actuation(steering, throttle);
+    }
+    else
+    {
+      size_t n_plan = length(random), n_next = length(random);
+      size_t plan_stride = stride(random), next_stride = stride(random);
+      size_t zeros = k % 2 == 0 ? length(random) : 0;
+      vector<double> plan_x = RandomValues(random, n_plan, plan_stride);
+      vector<double> plan_y = RandomValues(random, n_plan, plan_stride);
+      vector<double> next_x = RandomValues(random, n_next, next_stride);
+      vector<double> next_y = RandomValues(random, n_next, next_stride);
+      Series mpc_x(plan_x.data(), n_plan, plan_stride, zeros);
+      Series mpc_y(plan_y.data(), n_plan, plan_stride, zeros);
+      Series series_next_x(next_x.data(), n_next, next_stride);
+      Series series_next_y(next_y.data(), n_next, next_stride);
+      json message;
+      message["steering_angle"] = steering;
+      message["throttle"] = throttle;
+      message["mpc_x"] = Expand(mpc_x);
+      message["mpc_y"] = Expand(mpc_y);
+      message["next_x"] = Expand(series_next_x);
+      message["next_y"] = Expand(series_next_y);
+      expected = "42[\"steer\"," + message.dump() + "]";
+      writer.Steer(steering, throttle, mpc_x, mpc_y, series_next_x, series_next_y);
+    }
+    actual.assign(writer.Data(), writer.Size());
+    if (actual != expected)
+    {
+      printf("Reply %d differs\n json.dump(): %s\n ReplyWriter: %s\n", k, expected.c_str(),
+             actual.c_str());
+      return 1;
+    }
+  }
+  printf("%d replies identical\n", n_replies);
+  return 0;
+}
@@ -0,0 +1,212 @@
+#include "shm_transport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include "wire_format.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && ATOMIC_INT_LOCK_FREE == 2,
+              "the futex word is a lock-free 32 bit atomic");
+
+namespace {
+
+// Spinning before sleeping saves the wakeup, a few microseconds, when the
+// other side answers quickly. On a single CPU it would only delay the
+// other side.
+const double spin_seconds = std::thread::hardware_concurrency() > 1 ? 50e-6 : 0;
+
+// Not FUTEX_PRIVATE_FLAG: the word is shared between processes.
+long Futex(std::atomic<uint32_t> &word, int op, uint32_t value, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), op, value, timeout, NULL, 0);
+}
+
+double Now()
+{
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+bool shm_detail::Wait(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting,
+                      uint32_t value, double timeout)
+{
+  double start = Now();
+  while (word.load(std::memory_order_acquire) == value)
+  {
+    if (Now() - start > spin_seconds) { break; }
+  }
+  waiting.store(1, std::memory_order_seq_cst);
+  while (word.load(std::memory_order_seq_cst) == value)
+  {
+    struct timespec remaining;
+    if (timeout >= 0)
+    {
+      double left = start + timeout - Now();
+      if (left <= 0)
+      {
+        waiting.store(0, std::memory_order_relaxed);
+        return false;
+      }
+      remaining.tv_sec = time_t(left);
+      remaining.tv_nsec = long((left - remaining.tv_sec) * 1e9);
+    }
+    // Returns at once if the word is no longer `value`.
+    Futex(word, FUTEX_WAIT, value, timeout >= 0 ? &remaining : NULL);
+  }
+  waiting.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+void shm_detail::Wake(std::atomic<uint32_t> &word)
+{
+  Futex(word, FUTEX_WAKE, 1, NULL);
+}
+
+ShmChannel::ShmChannel() : segment(NULL), owner(false), inode(0) {}
+
+ShmChannel::~ShmChannel()
+{
+  if (segment != NULL) { munmap(segment, sizeof(ShmSegment)); }
+  if (!owner) { return; }
+  // Unless a newer controller has taken over the name meanwhile.
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  struct stat st;
+  if (fd < 0) { return; }
+  if (fstat(fd, &st) == 0 && st.st_ino == inode) { shm_unlink(name.c_str()); }
+  close(fd);
+}
+
+bool ShmChannel::Create(const string &name, string &error)
+{
+  this->name = name[0] == '/' ? name : "/" + name;
+  // Never reinitialize a segment in use: the processes still attached to
+  // an existing one keep it, and the name moves to a new segment.
+  int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST)
+  {
+    shm_unlink(this->name.c_str());
+    fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  struct stat st;
+  if (fd < 0 || ftruncate(fd, sizeof(ShmSegment)) != 0 || fstat(fd, &st) != 0)
+  {
+    error = this->name + ": " + strerror(errno);
+    if (fd >= 0) { close(fd); }
+    return false;
+  }
+  inode = st.st_ino;
+  void *memory = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    error = this->name + ": " + strerror(errno);
+    return false;
+  }
+  segment = new (memory) ShmSegment;
+  segment->telemetry.head.store(0);
+  segment->telemetry.tail.store(0);
+  segment->telemetry.waiting.store(0);
+  segment->commands.head.store(0);
+  segment->commands.tail.store(0);
+  segment->commands.waiting.store(0);
+  segment->size = sizeof(ShmSegment);
+  // Last, a client attaching before this sees no segment yet.
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(segment->magic, "MPCSHM1", 8);
+  owner = true;
+  return true;
+}
+
+bool ShmChannel::Attach(const string &name, string &error)
+{
+  this->name = name[0] == '/' ? name : "/" + name;
+  int fd = shm_open(this->name.c_str(), O_RDWR, 0);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    error = this->name + ": " + strerror(errno);
+    if (fd >= 0) { close(fd); }
+    return false;
+  }
+  if (size_t(st.st_size) != sizeof(ShmSegment))
+  {
+    close(fd);
+    error = this->name + ": not a segment of the controller";
+    return false;
+  }
+  void *memory = mmap(NULL, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+  {
+    error = this->name + ": " + strerror(errno);
+    return false;
+  }
+  segment = static_cast<ShmSegment *>(memory);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (memcmp(segment->magic, "MPCSHM1", 8) != 0 || segment->size != sizeof(ShmSegment))
+  {
+    munmap(memory, sizeof(ShmSegment));
+    segment = NULL;
+    error = this->name + ": not a segment of the controller";
+    return false;
+  }
+  // This is the only consumer of the commands.
+  segment->commands.tail.store(segment->commands.head.load());
+  return true;
+}
+
+bool ToShm(const Telemetry &telemetry, double time, ShmTelemetry &record)
+{
+  size_t n = telemetry.ptsx.size();
+  if (n > shm_max_points || telemetry.ptsy.size() != n) { return false; }
+  record.first = 0;
+  record.n_points = n;
+  record.x = telemetry.x;
+  record.y = telemetry.y;
+  record.psi = telemetry.psi;
+  record.speed = telemetry.speed;
+  record.steering_angle = telemetry.steering_angle;
+  record.throttle = telemetry.throttle;
+  record.time = time;
+  memcpy(record.ptsx, telemetry.ptsx.data(), n * sizeof(double));
+  memcpy(record.ptsy, telemetry.ptsy.data(), n * sizeof(double));
+  return true;
+}
+
+bool FromShm(const ShmTelemetry &record, Telemetry &telemetry, double &time, string &error)
+{
+  // ptsx and ptsy share the count, so both hold it when it fits.
+  size_t n = record.n_points;
+  if (n > shm_max_points)
+  {
+    error = "more waypoints than a record holds";
+    return false;
+  }
+  if (n < wire_min_points)
+  {
+    error = "too few waypoints";
+    return false;
+  }
+  telemetry.ptsx.assign(record.ptsx, record.ptsx + n);
+  telemetry.ptsy.assign(record.ptsy, record.ptsy + n);
+  telemetry.x = record.x;
+  telemetry.y = record.y;
+  telemetry.psi = record.psi;
+  telemetry.speed = record.speed;
+  telemetry.steering_angle = record.steering_angle;
+  telemetry.throttle = record.throttle;
+  time = record.time;
+  return true;
+}
@@ -0,0 +1,144 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
+#include "controller.h"
+
+using namespace std;
+
+// Transport between a simulator and the controller on the same host,
+// without TCP, websocket framing or JSON. The controller creates a POSIX
+// shared memory segment (mpc --shm name, /dev/shm/name), and the simulator
+// attaches to it (mpc_sim --shm name). The segment holds two
+// single-producer single-consumer rings of fixed-layout records, the
+// telemetry from the simulator to the controller and the commands back. A
+// reader that finds its ring empty spins for a few microseconds, then
+// sleeps in a futex on the head of the ring until the writer wakes it.
+// Records are in the byte order of the host.
+
+// Largest number of waypoints of a telemetry record.
+const size_t shm_max_points = 32;
+
+// Telemetry from the simulator.
+struct ShmTelemetry {
+  // Non-zero on the first frame of a client, whose clock starts again.
+  uint32_t first;
+  uint32_t n_points;
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+  // Simulated time in seconds, NaN if the sender has no clock.
+  double time;
+  double ptsx[shm_max_points];
+  double ptsy[shm_max_points];
+};
+
+// Actuators sent back by the controller.
+struct ShmCommand {
+  double steering_angle;
+  double throttle;
+};
+
+namespace shm_detail {
+// Wait until `word` differs from `value`, at most `timeout` seconds, or
+// forever if negative. Returns false on timeout. `waiting` tells the writer
+// to wake the futex.
+bool Wait(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting, uint32_t value,
+          double timeout);
+void Wake(std::atomic<uint32_t> &word);
+}
+
+// Single-producer single-consumer ring in shared memory. `head` counts the
+// records pushed and `tail` the records popped, both wrapping around.
+template <typename T>
+struct ShmRing {
+  static_assert(std::is_trivially_copyable<T>::value, "records are copied as bytes");
+  static const uint32_t capacity = 16;
+
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  // Whether the consumer sleeps on `head`, or is about to.
+  std::atomic<uint32_t> waiting;
+  alignas(64) T records[capacity];
+
+  // Returns false if the ring is full.
+  bool Push(const T &record)
+  {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == capacity) { return false; }
+    records[h % capacity] = record;
+    // Either the consumer sees the new head, or this sees that it waits.
+    head.store(h + 1, std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_seq_cst) != 0) { shm_detail::Wake(head); }
+    return true;
+  }
+
+  // Wait for a record at most `timeout` seconds, or forever if negative.
+  // Returns false on timeout.
+  bool Pop(T &record, double timeout)
+  {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (head.load(std::memory_order_acquire) == t &&
+        !shm_detail::Wait(head, waiting, t, timeout))
+    {
+      return false;
+    }
+    record = records[t % capacity];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+// Layout of the shared memory segment.
+struct ShmSegment {
+  // "MPCSHM1" and sizeof(ShmSegment), to reject a segment of another
+  // layout.
+  char magic[8];
+  uint64_t size;
+  ShmRing<ShmTelemetry> telemetry;
+  ShmRing<ShmCommand> commands;
+};
+
+// A mapping of the segment. The mapping is released on destruction, and
+// the segment is removed if this created it and still owns the name.
+class ShmChannel {
+public:
+  ShmChannel();
+  ~ShmChannel();
+
+  // Create the segment with empty rings, as the controller does. An
+  // existing segment of the same name, e.g. of another controller or left
+  // by a crashed one, is not touched: the name is taken over by a new
+  // segment, and clients still attached to the old one must attach again.
+  bool Create(const string &name, string &error);
+  // Attach to the segment of the controller, as a simulator does. Commands
+  // left over from a previous client are skipped.
+  bool Attach(const string &name, string &error);
+
+  ShmSegment *segment;
+
+private:
+  string name;
+  bool owner;
+  // Of the segment this created, to recognize it by name.
+  ino_t inode;
+
+  ShmChannel(const ShmChannel &);
+  ShmChannel &operator=(const ShmChannel &);
+};
+
+// Convert the telemetry. ToShm returns false if it has more than
+// shm_max_points waypoints. FromShm returns false with `error` set if the
+// record has more than shm_max_points or fewer than wire_min_points, as the
+// decoders of wire_format.h reject.
+bool ToShm(const Telemetry &telemetry, double time, ShmTelemetry &record);
+bool FromShm(const ShmTelemetry &record, Telemetry &telemetry, double &time, string &error);
+
+#endif /* SHM_TRANSPORT_H */
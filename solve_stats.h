@@ -0,0 +1,39 @@
+#ifndef SOLVE_STATS_H
+#define SOLVE_STATS_H
+
+// Statistics of one Ipopt solve.
+struct SolveStats {
+  // Ipopt iterations, including those of the restoration phase.
+  int iterations;
+  // Number of times the restoration phase was entered.
+  int restorations;
+  // Constraint violation and dual infeasibility at the end.
+  double constraint_violation;
+  double dual_infeasibility;
+  // Wall time of the whole solve after the CppAD tape was recorded, and of
+  // the evaluations of the objective, its gradient, the constraints, their
+  // Jacobian and the Hessian of the Lagrangian, in seconds. The rest of the
+  // time is spent inside Ipopt, `linear_solver_time` of it in the linear
+  // systems of the search direction, 0 if Ipopt does not time them.
+  double tape_time;
+  double total_time;
+  double linear_solver_time;
+  double eval_f_time;
+  double eval_grad_f_time;
+  double eval_g_time;
+  double eval_jac_g_time;
+  double eval_h_time;
+
+  SolveStats()
+    : iterations(0), restorations(0), constraint_violation(0), dual_infeasibility(0),
+      tape_time(0), total_time(0), linear_solver_time(0), eval_f_time(0),
+      eval_grad_f_time(0), eval_g_time(0), eval_jac_g_time(0), eval_h_time(0) {}
+
+  double EvalTime() const
+  {
+    return eval_f_time + eval_grad_f_time + eval_g_time + eval_jac_g_time + eval_h_time;
+  }
+  double IpoptTime() const { return total_time - EvalTime(); }
+};
+
+#endif /* SOLVE_STATS_H */
@@ -0,0 +1,183 @@
+#include "telemetry_log.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const char log_magic[8] = {'M', 'P', 'C', 'L', 'O', 'G', '0', '1'};
+const uint32_t log_version = 1;
+
+int64_t SteadyNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+LogRecord TelemetryRecord(const Telemetry &telemetry, int64_t time_ns, double sim_time)
+{
+  LogRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kind = LOG_TELEMETRY;
+  record.n_points = min(min(telemetry.ptsx.size(), telemetry.ptsy.size()), log_max_points);
+  record.time_ns = time_ns;
+  record.x = telemetry.x;
+  record.y = telemetry.y;
+  record.psi = telemetry.psi;
+  record.speed = telemetry.speed;
+  record.steering_angle = telemetry.steering_angle;
+  record.throttle = telemetry.throttle;
+  record.sim_time = sim_time;
+  for (size_t i=0; i<record.n_points; i++)
+  {
+    record.ptsx[i] = telemetry.ptsx[i];
+    record.ptsy[i] = telemetry.ptsy[i];
+  }
+  return record;
+}
+
+LogRecord SteerRecord(double steering, double throttle, int64_t time_ns)
+{
+  LogRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kind = LOG_STEER;
+  record.time_ns = time_ns;
+  record.steering_angle = steering;
+  record.throttle = throttle;
+  record.sim_time = NAN;
+  return record;
+}
+
+Telemetry RecordTelemetry(const LogRecord &record)
+{
+  Telemetry telemetry;
+  // The count comes from the file, which may be corrupt.
+  size_t n = min<size_t>(record.n_points, log_max_points);
+  telemetry.ptsx.assign(record.ptsx, record.ptsx + n);
+  telemetry.ptsy.assign(record.ptsy, record.ptsy + n);
+  telemetry.x = record.x;
+  telemetry.y = record.y;
+  telemetry.psi = record.psi;
+  telemetry.speed = record.speed;
+  telemetry.steering_angle = record.steering_angle;
+  telemetry.throttle = record.throttle;
+  return telemetry;
+}
+
+TelemetryLogWriter::TelemetryLogWriter() : file(NULL), start_ns(0) {}
+
+TelemetryLogWriter::~TelemetryLogWriter()
+{
+  Close();
+}
+
+bool TelemetryLogWriter::Open(const string &path, string &error)
+{
+  Close();
+  file = fopen(path.c_str(), "wb");
+  if (file == NULL)
+  {
+    error = "cannot create " + path + ": " + strerror(errno);
+    return false;
+  }
+  LogHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, log_magic, sizeof(log_magic));
+  header.version = log_version;
+  header.record_size = sizeof(LogRecord);
+  header.start_unix_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  start_ns = SteadyNs();
+  fwrite(&header, sizeof(header), 1, file);
+  return true;
+}
+
+void TelemetryLogWriter::Close()
+{
+  if (file != NULL)
+  {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+int64_t TelemetryLogWriter::Now() const
+{
+  return SteadyNs() - start_ns;
+}
+
+void TelemetryLogWriter::Append(const LogRecord &record)
+{
+  if (file == NULL) { return; }
+  fwrite(&record, sizeof(record), 1, file);
+  // One write per record, a few microseconds, so that a recorder that is
+  // killed keeps all the records but the one being written.
+  fflush(file);
+}
+
+TelemetryLog::TelemetryLog()
+  : data(NULL), length(0), header(NULL), records(NULL), n_records(0) {}
+
+TelemetryLog::~TelemetryLog()
+{
+  Close();
+}
+
+bool TelemetryLog::Open(const string &path, string &error)
+{
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    error = "cannot open " + path + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LogHeader))
+  {
+    close(fd);
+    error = path + " is not a telemetry log";
+    return false;
+  }
+  length = st.st_size;
+  data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    data = NULL;
+    error = "cannot map " + path + ": " + strerror(errno);
+    return false;
+  }
+  header = (const LogHeader *)data;
+  if (memcmp(header->magic, log_magic, sizeof(log_magic)) != 0 ||
+      header->version != log_version || header->record_size != sizeof(LogRecord))
+  {
+    Close();
+    error = path + " is not a telemetry log of this version";
+    return false;
+  }
+  // Records are read in order, let the kernel read ahead.
+  madvise(data, length, MADV_SEQUENTIAL);
+  records = (const LogRecord *)((const char *)data + sizeof(LogHeader));
+  // A log cut short by a crash ends with a partial record, which is ignored.
+  n_records = (length - sizeof(LogHeader)) / sizeof(LogRecord);
+  return true;
+}
+
+void TelemetryLog::Close()
+{
+  if (data != NULL) { munmap(data, length); }
+  data = NULL;
+  length = 0;
+  header = NULL;
+  records = NULL;
+  n_records = 0;
+}
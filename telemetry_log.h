@@ -0,0 +1,111 @@
+#ifndef TELEMETRY_LOG_H
+#define TELEMETRY_LOG_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include "controller.h"
+
+using namespace std;
+
+// Binary log of a driving session: a header followed by fixed size records,
+// one per inbound telemetry message and one per outbound steer reply, in
+// the order they happened. The records are written in the byte order of
+// the host and read back in place with mmap.
+
+// Most waypoints kept of a telemetry message, the simulator sends 6.
+const size_t log_max_points = 16;
+
+enum LogRecordKind {
+  LOG_TELEMETRY = 1,
+  LOG_STEER = 2
+};
+
+struct LogRecord {
+  // LogRecordKind
+  uint32_t kind;
+  // Number of waypoints stored in ptsx and ptsy.
+  uint32_t n_points;
+  // Receive time of a telemetry message or send time of a steer reply, in
+  // nanoseconds of the steady clock since the start of the log.
+  int64_t time_ns;
+  // Telemetry: map position and orientation, speed in mph. Unused by steer
+  // replies.
+  double x;
+  double y;
+  double psi;
+  double speed;
+  // Telemetry: current actuators, the steering angle in radians.
+  // Steer: the command sent, the steering in [-1, 1].
+  double steering_angle;
+  double throttle;
+  // Simulated time of the telemetry, NaN if the simulator sent none.
+  double sim_time;
+  double ptsx[log_max_points];
+  double ptsy[log_max_points];
+};
+
+struct LogHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  // Wall clock at the start of the log, in nanoseconds since the epoch.
+  int64_t start_unix_ns;
+};
+
+LogRecord TelemetryRecord(const Telemetry &telemetry, int64_t time_ns, double sim_time);
+LogRecord SteerRecord(double steering, double throttle, int64_t time_ns);
+Telemetry RecordTelemetry(const LogRecord &record);
+
+// Appends records to a log file.
+class TelemetryLogWriter {
+public:
+  TelemetryLogWriter();
+  virtual ~TelemetryLogWriter();
+
+  // Create or truncate the file and write the header.
+  bool Open(const string &path, string &error);
+  void Close();
+  bool IsOpen() const { return file != NULL; }
+
+  // Nanoseconds since the start of the log, to time stamp the records.
+  int64_t Now() const;
+
+  // Write a record through to the file.
+  void Append(const LogRecord &record);
+
+private:
+  FILE *file;
+  int64_t start_ns;
+
+  TelemetryLogWriter(const TelemetryLogWriter &);
+  TelemetryLogWriter &operator=(const TelemetryLogWriter &);
+};
+
+// Read-only view of a log file, mapped in memory.
+class TelemetryLog {
+public:
+  TelemetryLog();
+  virtual ~TelemetryLog();
+
+  bool Open(const string &path, string &error);
+  void Close();
+
+  const LogHeader &Header() const { return *header; }
+  size_t Size() const { return n_records; }
+  const LogRecord &operator[](size_t i) const { return records[i]; }
+  const LogRecord *begin() const { return records; }
+  const LogRecord *end() const { return records + n_records; }
+
+private:
+  void *data;
+  size_t length;
+  const LogHeader *header;
+  const LogRecord *records;
+  size_t n_records;
+
+  TelemetryLog(const TelemetryLog &);
+  TelemetryLog &operator=(const TelemetryLog &);
+};
+
+#endif /* TELEMETRY_LOG_H */
@@ -0,0 +1,181 @@
+#include "trace.h"
+#include <pthread.h>
+#include <signal.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace trace_detail {
+std::atomic<bool> enabled(false);
+}
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  int64_t start;
+  int64_t end;
+  int64_t arg;
+};
+
+// Spans of one thread. Only its thread writes a ring, and `head` counts the
+// spans written so far, published after each write. A reader copies the
+// ring and drops the spans that may have been overwritten meanwhile. Rings
+// outlive their thread, so the spans of finished threads remain.
+struct alignas(64) TraceRing {
+  std::atomic<uint64_t> head;
+  std::atomic<const char *> thread_name;
+  int tid;
+  TraceEvent events[trace_capacity];
+};
+
+std::mutex registry_mutex;
+std::vector<TraceRing *> registry;
+// Spans starting before this were recorded before the last StartTrace.
+std::atomic<int64_t> trace_start(0);
+
+thread_local TraceRing *thread_ring = NULL;
+thread_local const char *thread_name = NULL;
+
+TraceRing *Ring()
+{
+  if (thread_ring == NULL)
+  {
+    void *memory = NULL;
+    if (posix_memalign(&memory, 64, sizeof(TraceRing)) != 0) { return NULL; }
+    TraceRing *ring = new (memory) TraceRing();
+    ring->head.store(0);
+    ring->thread_name.store(thread_name);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    ring->tid = registry.size() + 1;
+    registry.push_back(ring);
+    thread_ring = ring;
+  }
+  return thread_ring;
+}
+
+}  // namespace
+
+void StartTrace()
+{
+  trace_start.store(TraceNow());
+  trace_detail::enabled.store(true);
+}
+
+void StopTrace()
+{
+  trace_detail::enabled.store(false);
+}
+
+void TraceComplete(const char *name, int64_t start, int64_t end, int64_t arg)
+{
+  if (!TraceEnabled()) { return; }
+  TraceRing *ring = Ring();
+  if (ring == NULL) { return; }
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  TraceEvent &event = ring->events[head % trace_capacity];
+  event.name = name;
+  event.start = start;
+  event.end = end;
+  event.arg = arg;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(const char *name)
+{
+  thread_name = name;
+  // Otherwise the ring takes the name when the first span allocates it.
+  if (thread_ring != NULL) { thread_ring->thread_name.store(name); }
+}
+
+string TraceJson()
+{
+  std::vector<TraceRing *> rings;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    rings = registry;
+  }
+  int64_t origin = trace_start.load();
+  string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  char line[256];
+  std::vector<TraceEvent> events;
+  for (TraceRing *ring : rings)
+  {
+    const char *name = ring->thread_name.load();
+    if (name != NULL)
+    {
+      snprintf(line, sizeof(line),
+               "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+               "\"args\":{\"name\":\"%s\"}}",
+               first ? "" : ",", ring->tid, name);
+      json += line;
+      first = false;
+    }
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t begin = head > trace_capacity ? head - trace_capacity : 0;
+    events.clear();
+    for (uint64_t i=begin; i<head; i++) { events.push_back(ring->events[i % trace_capacity]); }
+    // The spans the thread may have overwritten while they were copied,
+    // including the slot of index `now`, which it may be writing.
+    uint64_t now = ring->head.load(std::memory_order_acquire);
+    uint64_t valid = now + 1 > trace_capacity ? now + 1 - trace_capacity : 0;
+    for (uint64_t i=max(begin, valid); i<head; i++)
+    {
+      const TraceEvent &event = events[i - begin];
+      if (event.start < origin) { continue; }
+      int n = snprintf(line, sizeof(line),
+                       "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f",
+                       first ? "" : ",", event.name, ring->tid, (event.start - origin) * 1e-3,
+                       (event.end - event.start) * 1e-3);
+      if (event.arg >= 0 && n > 0 && n < (int)sizeof(line))
+      {
+        snprintf(line + n, sizeof(line) - n, ",\"args\":{\"n\":%lld}", (long long)event.arg);
+      }
+      json += line;
+      json += "}";
+      first = false;
+    }
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+bool WriteTrace(const string &path, string &error)
+{
+  string json = TraceJson();
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == NULL)
+  {
+    error = "cannot open " + path;
+    return false;
+  }
+  bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+  ok &= fclose(file) == 0;
+  if (!ok) { error = "cannot write " + path; }
+  return ok;
+}
+
+void DumpTraceOnSignal(int signum, const string &path)
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, signum);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  std::thread([signals, path]() {
+    SetTraceThreadName("trace");
+    while (true)
+    {
+      int signum;
+      if (sigwait(&signals, &signum) != 0) { continue; }
+      string error;
+      if (WriteTrace(path, error)) { fprintf(stderr, "Trace written to %s\n", path.c_str()); }
+      else { fprintf(stderr, "Failed to write the trace: %s\n", error.c_str()); }
+    }
+  }).detach();
+}
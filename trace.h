@@ -0,0 +1,79 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+using namespace std;
+
+// Timeline of the control loop in the Chrome trace event format, to be
+// opened in chrome://tracing or ui.perfetto.dev.
+//
+// Each thread records its spans into its own ring buffer of the last
+// trace_capacity spans, without locks. Recording is off by default, and
+// then a span costs one relaxed load of a flag.
+
+const size_t trace_capacity = 1 << 16;
+
+namespace trace_detail {
+extern std::atomic<bool> enabled;
+}
+
+inline bool TraceEnabled()
+{
+  return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Start or stop recording. Starting discards the spans recorded before.
+void StartTrace();
+void StopTrace();
+
+// Time of the trace clock in nanoseconds.
+inline int64_t TraceTime(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+inline int64_t TraceNow() { return TraceTime(std::chrono::steady_clock::now()); }
+
+// Record a span of the calling thread from `start` to `end`, in the time of
+// the trace clock. `name` must outlive the trace, e.g. a string literal.
+// `arg` is shown with the span unless negative, e.g. an iteration number.
+void TraceComplete(const char *name, int64_t start, int64_t end, int64_t arg = -1);
+
+// Name of the calling thread in the timeline, e.g. "io" or "solver". `name`
+// must outlive the trace. The ring of the thread is only allocated by its
+// first span recorded while tracing is on, so threads that never record one
+// cost no memory.
+void SetTraceThreadName(const char *name);
+
+// Span of the lifetime of the object, recorded if tracing was on at its
+// start.
+class TraceSpan {
+public:
+  TraceSpan(const char *name, int64_t arg = -1)
+    : name(name), arg(arg), start(TraceEnabled() ? TraceNow() : -1) {}
+  ~TraceSpan()
+  {
+    if (start >= 0) { TraceComplete(name, start, TraceNow(), arg); }
+  }
+
+private:
+  const char *name;
+  int64_t arg;
+  int64_t start;
+};
+
+// The spans of all threads as Chrome trace JSON. This can run while the
+// other threads record.
+string TraceJson();
+bool WriteTrace(const string &path, string &error);
+
+// Write the trace to `path` whenever the process receives `signum`, e.g.
+// SIGUSR1. The signal is handled by a thread of its own, so this must be
+// called before any other thread is started, which inherit the blocked
+// signal.
+void DumpTraceOnSignal(int signum, const string &path);
+
+#endif /* TRACE_H */
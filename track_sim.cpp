@@ -0,0 +1,197 @@
+#include "track_sim.h"
+#include <math.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include "vehicle_model.h"
+
+bool Track::Load(const string &path, string &error)
+{
+  std::ifstream file(path.c_str());
+  if (!file)
+  {
+    error = "cannot open " + path;
+    return false;
+  }
+  x.clear();
+  y.clear();
+  string line;
+  while (std::getline(file, line))
+  {
+    const char *begin = line.c_str();
+    char *end;
+    double px = strtod(begin, &end);
+    if (end == begin) { continue; }
+    while (*end == ',' || *end == ' ' || *end == '\t') { end++; }
+    const char *second = end;
+    double py = strtod(second, &end);
+    if (end == second) { continue; }
+    x.push_back(px);
+    y.push_back(py);
+  }
+  if (x.size() < 3)
+  {
+    error = path + " has less than 3 waypoints";
+    return false;
+  }
+  Init();
+  return true;
+}
+
+Track Track::Synthetic(double radius, double amplitude, size_t lobes, double spacing)
+{
+  Track track;
+  size_t n = max((size_t)3, (size_t)(2 * M_PI * radius / spacing));
+  for (size_t i=0; i<n; i++)
+  {
+    double theta = 2 * M_PI * i / n;
+    double r = radius * (1 + amplitude * sin(lobes * theta));
+    track.x.push_back(r * cos(theta));
+    track.y.push_back(r * sin(theta));
+  }
+  track.Init();
+  return track;
+}
+
+void Track::Init()
+{
+  s.assign(1, 0.0);
+  for (size_t i=0; i<x.size(); i++)
+  {
+    size_t k = (i + 1) % x.size();
+    s.push_back(s.back() + hypot(x[k] - x[i], y[k] - y[i]));
+  }
+}
+
+size_t Track::Segment(double arc) const
+{
+  arc = fmod(arc, Length());
+  if (arc < 0) { arc += Length(); }
+  size_t i = upper_bound(s.begin(), s.end(), arc) - s.begin();
+  return min(i, x.size()) - 1;
+}
+
+void Track::Project(double px, double py, double &arc, double &offset) const
+{
+  double best = -1;
+  for (size_t i=0; i<x.size(); i++)
+  {
+    size_t k = (i + 1) % x.size();
+    double dx = x[k] - x[i];
+    double dy = y[k] - y[i];
+    double len = s[i + 1] - s[i];
+    double t = ((px - x[i]) * dx + (py - y[i]) * dy) / (len * len);
+    t = max(0.0, min(1.0, t));
+    double ex = px - (x[i] + t * dx);
+    double ey = py - (y[i] + t * dy);
+    double dist = hypot(ex, ey);
+    if (best < 0 || dist < best)
+    {
+      best = dist;
+      arc = s[i] + t * len;
+      // Left of the direction of travel is positive.
+      offset = (dx * ey - dy * ex) >= 0 ? dist : -dist;
+    }
+  }
+}
+
+void Track::Pose(double arc, double &px, double &py, double &psi) const
+{
+  size_t i = Segment(arc);
+  size_t k = (i + 1) % x.size();
+  arc = fmod(arc, Length());
+  if (arc < 0) { arc += Length(); }
+  double t = (arc - s[i]) / (s[i + 1] - s[i]);
+  px = x[i] + t * (x[k] - x[i]);
+  py = y[i] + t * (y[k] - y[i]);
+  psi = atan2(y[k] - y[i], x[k] - x[i]);
+}
+
+void Track::Waypoints(double arc, size_t n, vector<double> &ptsx, vector<double> &ptsy) const
+{
+  size_t i = Segment(arc);
+  ptsx.resize(n);
+  ptsy.resize(n);
+  for (size_t k=0; k<n; k++)
+  {
+    ptsx[k] = x[(i + k) % x.size()];
+    ptsy[k] = y[(i + k) % x.size()];
+  }
+}
+
+TrackSim::TrackSim(const Track &track, const SimConfig &config)
+  : track(track), config(config)
+{
+  Reset(0, 0);
+}
+
+void TrackSim::Reset(double arc, double v)
+{
+  track.Pose(arc, px, py, psi);
+  this->v = v;
+  delta = 0;
+  a = 0;
+  time = 0;
+  distance = 0;
+  pending.clear();
+  track.Project(px, py, this->arc, offset);
+}
+
+Telemetry TrackSim::Observe() const
+{
+  Telemetry telemetry;
+  track.Waypoints(arc, config.n_waypoints, telemetry.ptsx, telemetry.ptsy);
+  telemetry.x = px;
+  telemetry.y = py;
+  telemetry.psi = psi;
+  // The simulator reports mph.
+  telemetry.speed = v / 0.44704;
+  telemetry.steering_angle = delta;
+  telemetry.throttle = a / config.max_accel;
+  return telemetry;
+}
+
+void TrackSim::Command(double steering, double throttle, double delay)
+{
+  PendingCommand command;
+  command.time = time + delay;
+  command.steering = max(-1.0, min(1.0, steering));
+  command.throttle = max(-1.0, min(1.0, throttle));
+  pending.push_back(command);
+}
+
+void TrackSim::ApplyCommands(double t)
+{
+  while (!pending.empty() && pending.front().time <= t)
+  {
+    delta = pending.front().steering * config.max_steer;
+    a = pending.front().throttle * config.max_accel;
+    pending.pop_front();
+  }
+}
+
+void TrackSim::Advance(double duration)
+{
+  double end = time + duration;
+  while (time < end)
+  {
+    ApplyCommands(time);
+    double h = min(config.dt, end - time);
+    // Kinematic bicycle model, a positive steering angle turns right.
+    px += v * cos(psi) * h;
+    py += v * sin(psi) * h;
+    psi -= v * delta / Lf * h;
+    v = max(0.0, v + a * h);
+    time += h;
+  }
+  // A command due at the end takes effect now, so the next telemetry
+  // reports it.
+  ApplyCommands(end);
+  // Follow the progress along the track across the start line.
+  double arc_prev = arc;
+  track.Project(px, py, arc, offset);
+  double ds = arc - arc_prev;
+  if (ds > track.Length() / 2) { ds -= track.Length(); }
+  if (ds < -track.Length() / 2) { ds += track.Length(); }
+  distance += ds;
+}
@@ -0,0 +1,113 @@
+#ifndef TRACK_SIM_H
+#define TRACK_SIM_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "controller.h"
+
+using namespace std;
+
+// Closed track given by its waypoints in map coordinates, traversed in the
+// order of the waypoints.
+class Track {
+public:
+  // Load the waypoints from a CSV file with one "x,y" pair per line, in the
+  // format of lake_track_waypoints.csv of the simulator. Lines that do not
+  // start with a number, e.g. a header, are skipped.
+  bool Load(const string &path, string &error);
+
+  // Synthetic track: a circle of `radius` whose radius varies by the
+  // fraction `amplitude` over `lobes` periods, giving bends of different
+  // sharpness, sampled every `spacing` meters.
+  static Track Synthetic(double radius, double amplitude, size_t lobes, double spacing);
+
+  size_t Size() const { return x.size(); }
+  double Length() const { return s.back(); }
+
+  // Project a point on the track: arc length from the first waypoint and
+  // signed distance from the track, positive on the left.
+  void Project(double px, double py, double &arc, double &offset) const;
+
+  // Position and heading on the track at arc length `arc`.
+  void Pose(double arc, double &px, double &py, double &psi) const;
+
+  // `n` consecutive waypoints starting with the one behind arc length `arc`,
+  // as the simulator sends them.
+  void Waypoints(double arc, size_t n, vector<double> &ptsx, vector<double> &ptsy) const;
+
+private:
+  vector<double> x;
+  vector<double> y;
+  // Arc length at each waypoint, one more than the waypoints to close the loop.
+  vector<double> s;
+
+  void Init();
+  size_t Segment(double arc) const;
+};
+
+// Settings of TrackSim.
+struct SimConfig {
+  // Steering angle of a command of 1, in radians.
+  double max_steer;
+  // Acceleration of a throttle of 1, in m/s^2.
+  double max_accel;
+  // Integration step of the vehicle in seconds.
+  double dt;
+  // Number of waypoints in each telemetry message.
+  size_t n_waypoints;
+
+  SimConfig() : max_steer(0.436332), max_accel(4.0), dt(0.005), n_waypoints(6) {}
+};
+
+// Kinematic stand-in for the simulator: drives a kinematic bicycle along a
+// track and produces the telemetry the simulator would send. Time only
+// advances when asked to, so it runs as fast as the controller.
+class TrackSim {
+public:
+  TrackSim(const Track &track, const SimConfig &config);
+
+  // Place the vehicle on the track at arc length `arc`, heading along the
+  // track at speed `v` in m/s, with the actuators at zero.
+  void Reset(double arc, double v);
+
+  // Telemetry at the current time.
+  Telemetry Observe() const;
+
+  // Steer command as sent by the controller: steering in [-1, 1], positive
+  // to the right, and throttle in [-1, 1]. It takes effect `delay` seconds
+  // from now.
+  void Command(double steering, double throttle, double delay);
+
+  // Drive for `duration` seconds.
+  void Advance(double duration);
+
+  // Simulated time in seconds.
+  double Time() const { return time; }
+  // Distance driven along the track since Reset, negative when backwards.
+  double Distance() const { return distance; }
+  // Signed distance from the track, positive on the left.
+  double Offset() const { return offset; }
+  // Speed in m/s.
+  double Speed() const { return v; }
+
+private:
+  struct PendingCommand {
+    double time;
+    double steering;
+    double throttle;
+  };
+
+  const Track &track;
+  SimConfig config;
+  double time;
+  double px, py, psi, v;
+  double delta, a;
+  double arc, distance, offset;
+  deque<PendingCommand> pending;
+
+  // Apply the commands that are due at `t`.
+  void ApplyCommands(double t);
+};
+
+#endif /* TRACK_SIM_H */
@@ -0,0 +1,403 @@
+#ifndef VEHICLE_MODEL_H
+#define VEHICLE_MODEL_H
+
+#include <cmath>
+#include "Eigen-3.3/Eigen/Core"
+#include "integrator.h"
+
+// This value assumes the model presented in the classroom is used.
+// Lf was obtained by measuring the radius formed by running the vehicle in the
+// simulator around in a circle with a constant steering angle and velocity on a
+// flat terrain.
+// Lf was tuned until the the radius formed by the simulating the model
+// presented in the classroom matched the previous radius.
+// This is the length from front to CoG that has a similar radius.
+const double Lf = 2.67;
+
+// Models the MPC can be set up with.
+enum ModelType {
+  KINEMATIC_MODEL,
+  DYNAMIC_BICYCLE_MODEL,
+  FRENET_MODEL
+};
+
+// A vehicle model describes the variables of the NLP and how the state
+// evolves over one interval of the horizon. The dimensions are compile time
+// constants, so the layout, the bounds and the taped operations of FG_eval
+// are generated from them with fixed size arrays. A model provides:
+//
+//   n_states, n_inputs        state and actuator dimensions
+//   n_params                  number of parameters of each stage
+//   CTE, EPSI, V              states penalised by the cost
+//   DELTA, A                  steering and acceleration actuators
+//   input_lower, input_upper  actuator bounds
+//   stage_params(s0, coeffs, time, p)
+//                             parameters of the stage `time` seconds after
+//                             the initial state s0, computed once per solve
+//   derivative(s, u, p, sdot) time derivative of the state, the actuators
+//                             being constant
+//   step(s0, u0, p, coeffs, dt, integrator, substeps, s1)
+//                             state after one interval of length dt
+//   curvature(s, p, coeffs)   curvature of the reference line next to s
+//   position(s, coeffs, x, y) position in the vehicle frame for display
+//   initial_state(v, cte, epsi, delta, s)
+//                             state at the telemetry sample, in the
+//                             vehicle frame
+//
+// The derivative and step functions are templated on the scalar type so
+// that they serve both the NLP (CppAD::AD<double>) and plain predictions.
+// Stage parameters are plain doubles: anything that only depends on the
+// reference line is evaluated there instead of inside the tape.
+
+// Evaluate the third order reference polynomial and its slope.
+template <typename T>
+T polyeval3(const Eigen::VectorXd &coeffs, const T &x)
+{
+  return coeffs[0] + coeffs[1] * x + coeffs[2] * x * x + coeffs[3] * x * x * x;
+}
+
+template <typename T>
+T polyslope3(const Eigen::VectorXd &coeffs, const T &x)
+{
+  return coeffs[1] + 2 * coeffs[2] * x + 3 * coeffs[3] * x * x;
+}
+
+// Binds the actuators of an interval to the derivative of a model.
+template <class Model, typename T>
+struct ModelDerivative {
+  const T *u;
+  const double *p;
+  void operator()(const T *s, T *sdot) { Model::derivative(s, u, p, sdot); }
+};
+
+// Advance a model whose state carries x, y, psi, cte and epsi by one
+// interval. As in the classroom model, cte and epsi restart from the errors
+// relative to the reference line f at the start of the interval, i.e.
+// f(x) - y and psi - psides, and only their change is integrated.
+template <class Model, typename T>
+void PathAnchoredStep(const T *s0, const T *u0, const double *p,
+                      const Eigen::VectorXd &coeffs, double dt,
+                      Integrator method, size_t substeps, T *s1)
+{
+  using std::atan;
+  const T &x0 = s0[Model::X];
+  // Calculate f0 and psides0
+  T f0 = polyeval3(coeffs, x0);
+  T psides0 = atan(polyslope3(coeffs, x0));
+  ModelDerivative<Model, T> f = {u0, p};
+  T ds[Model::n_states];
+  IntegrateIncrement<Model::n_states>(method, substeps, f, s0, dt, ds);
+  for (size_t i=0; i<Model::n_states; i++) { s1[i] = s0[i] + ds[i]; }
+  s1[Model::CTE] = (f0 - s0[Model::Y]) + ds[Model::CTE];
+  s1[Model::EPSI] = (s0[Model::PSI] - psides0) + ds[Model::EPSI];
+}
+
+// Curvature of the reference line at x as the cost weighs it. The exponent
+// 3/2 is an integer division, so the denominator is 1 + f'^2 rather than
+// (1 + f'^2)^1.5. The curvature weight c10 was tuned with it, and every
+// model penalizes this same quantity so that weights carry over between
+// the models.
+template <typename T>
+T CostCurvature(const Eigen::VectorXd &coeffs, const T &x)
+{
+  using std::abs;
+  using std::pow;
+  T numerator = abs(2 * coeffs[2] + 6 * coeffs[3] * x);
+  T denominator = pow(1 + pow(polyslope3(coeffs, x), 2), 3/2);
+  return numerator / denominator;
+}
+
+// Cost curvature of the reference line at the x position of the state.
+template <class Model, typename T>
+T PathCurvatureAtX(const T *s, const Eigen::VectorXd &coeffs)
+{
+  return CostCurvature(coeffs, s[Model::X]);
+}
+
+// Kinematic bicycle model.
+// State [x, y, psi, v, cte, epsi], actuators [delta, a].
+// x'    = v * cos(psi)
+// y'    = v * sin(psi)
+// psi'  = - v * delta / Lf
+// v'    = a
+// cte'  = v * sin(epsi)
+// epsi' = - v * delta / Lf
+// With EULER, step() is exactly the classroom model:
+// x[t+1]    = x[t] + v[t] * cos(psi[t]) * dt
+// y[t+1]    = y[t] + v[t] * sin(psi[t]) * dt
+// psi[t+1]  = psi[t] - v[t] / Lf * delta[t] * dt
+// v[t+1]    = v[t] + a[t] * dt
+// cte[t+1]  = f(x[t]) - y[t] + v[t] * sin(epsi[t]) * dt
+// epsi[t+1] = psi[t] - psides[t] - v[t] * delta[t] / Lf * dt
+struct KinematicModel {
+  static const size_t n_states = 6;
+  static const size_t n_inputs = 2;
+  static const size_t n_params = 0;
+  enum { X, Y, PSI, V, CTE, EPSI };
+  enum { DELTA, A };
+
+  // The upper and lower limits of delta are set to -25 and 25
+  // degrees (values in radians), acceleration/decceleration to [-1, 1].
+  static double input_lower(size_t j) { return (j == DELTA) ? -0.436332 : -1.0; }
+  static double input_upper(size_t j) { return (j == DELTA) ? 0.436332 : 1.0; }
+
+  static void stage_params(const double *s0, const Eigen::VectorXd &coeffs,
+                           double time, double *p) {}
+
+  template <typename T>
+  static void derivative(const T *s, const T *u, const double *p, T *sdot)
+  {
+    using std::cos;
+    using std::sin;
+    sdot[X] = s[V] * cos(s[PSI]);
+    sdot[Y] = s[V] * sin(s[PSI]);
+    sdot[PSI] = - s[V] * u[DELTA] / Lf;
+    sdot[V] = u[A];
+    sdot[CTE] = s[V] * sin(s[EPSI]);
+    sdot[EPSI] = - s[V] * u[DELTA] / Lf;
+  }
+
+  template <typename T>
+  static void step(const T *s0, const T *u0, const double *p,
+                   const Eigen::VectorXd &coeffs, double dt,
+                   Integrator method, size_t substeps, T *s1)
+  {
+    PathAnchoredStep<KinematicModel>(s0, u0, p, coeffs, dt, method, substeps, s1);
+  }
+
+  template <typename T>
+  static T curvature(const T *s, const double *p, const Eigen::VectorXd &coeffs)
+  {
+    return PathCurvatureAtX<KinematicModel>(s, coeffs);
+  }
+
+  static void position(const double *s, const Eigen::VectorXd &coeffs,
+                       double &x, double &y)
+  {
+    x = s[X];
+    y = s[Y];
+  }
+
+  // Recall in the local vehicle system, we have px = py = psi = 0, v=v
+  static void initial_state(double v, double cte, double epsi, double delta,
+                            double *s)
+  {
+    s[X] = 0;
+    s[Y] = 0;
+    s[PSI] = 0;
+    s[V] = v;
+    s[CTE] = cte;
+    s[EPSI] = epsi;
+  }
+};
+
+// Dynamic bicycle model with linear tire forces.
+// State [x, y, psi, vx, vy, r, cte, epsi], actuators [delta, a], where vx
+// and vy are the longitudinal and lateral velocities in the body frame and
+// r is the yaw rate. The steering angle keeps the simulator convention of
+// the kinematic model, i.e. positive delta turns right (psi decreasing).
+// x'    = vx * cos(psi) - vy * sin(psi)
+// y'    = vx * sin(psi) + vy * cos(psi)
+// psi'  = r
+// vx'   = a - Fyf * sin(-delta) / m + vy * r
+// vy'   = (Fyf * cos(-delta) + Fyr) / m - vx * r
+// r'    = (lf * Fyf * cos(-delta) - lr * Fyr) / Iz
+// cte'  = vx * sin(epsi) + vy * cos(epsi)
+// epsi' = r
+// with the tire forces Fyf = Cf * alpha_f, Fyr = Cr * alpha_r and the slip
+// angles alpha_f = -delta - atan((vy + lf * r) / vx),
+// alpha_r = - atan((vy - lr * r) / vx).
+struct DynamicBicycleModel {
+  static const size_t n_states = 8;
+  static const size_t n_inputs = 2;
+  static const size_t n_params = 0;
+  enum { X, Y, PSI, V, VY, R, CTE, EPSI };
+  enum { DELTA, A };
+
+  // Vehicle parameters. The axle distances add up to Lf so that the model
+  // turns like the kinematic model at low speed.
+  static double mass() { return 1500.0; }         // kg
+  static double inertia() { return 2250.0; }      // kg m^2
+  static double lf() { return 1.2; }              // m
+  static double lr() { return Lf - 1.2; }         // m
+  static double cornering_f() { return 80000.0; } // N/rad
+  static double cornering_r() { return 80000.0; } // N/rad
+
+  static double input_lower(size_t j) { return KinematicModel::input_lower(j); }
+  static double input_upper(size_t j) { return KinematicModel::input_upper(j); }
+
+  static void stage_params(const double *s0, const Eigen::VectorXd &coeffs,
+                           double time, double *p) {}
+
+  template <typename T>
+  static void derivative(const T *s, const T *u, const double *p, T *sdot)
+  {
+    using std::atan;
+    using std::cos;
+    using std::sin;
+    using std::sqrt;
+    const T &vx = s[V];
+    const T &vy = s[VY];
+    const T &r = s[R];
+    T steer = - u[DELTA];
+    // Smooth lower bound on vx keeps the slip angles finite at standstill.
+    T vxs = sqrt(vx * vx + 1.0);
+    T alpha_f = steer - atan((vy + lf() * r) / vxs);
+    T alpha_r = - atan((vy - lr() * r) / vxs);
+    T fyf = cornering_f() * alpha_f;
+    T fyr = cornering_r() * alpha_r;
+    sdot[X] = vx * cos(s[PSI]) - vy * sin(s[PSI]);
+    sdot[Y] = vx * sin(s[PSI]) + vy * cos(s[PSI]);
+    sdot[PSI] = r;
+    sdot[V] = u[A] - fyf * sin(steer) / mass() + vy * r;
+    sdot[VY] = (fyf * cos(steer) + fyr) / mass() - vx * r;
+    sdot[R] = (lf() * fyf * cos(steer) - lr() * fyr) / inertia();
+    sdot[CTE] = vx * sin(s[EPSI]) + vy * cos(s[EPSI]);
+    sdot[EPSI] = r;
+  }
+
+  template <typename T>
+  static void step(const T *s0, const T *u0, const double *p,
+                   const Eigen::VectorXd &coeffs, double dt,
+                   Integrator method, size_t substeps, T *s1)
+  {
+    PathAnchoredStep<DynamicBicycleModel>(s0, u0, p, coeffs, dt, method, substeps, s1);
+  }
+
+  template <typename T>
+  static T curvature(const T *s, const double *p, const Eigen::VectorXd &coeffs)
+  {
+    return PathCurvatureAtX<DynamicBicycleModel>(s, coeffs);
+  }
+
+  static void position(const double *s, const Eigen::VectorXd &coeffs,
+                       double &x, double &y)
+  {
+    x = s[X];
+    y = s[Y];
+  }
+
+  // The simulator does not report vy and r. Start from the steady state
+  // yaw rate of the kinematic model for the current steering and no slip.
+  static void initial_state(double v, double cte, double epsi, double delta,
+                            double *s)
+  {
+    s[X] = 0;
+    s[Y] = 0;
+    s[PSI] = 0;
+    s[V] = v;
+    s[VY] = 0;
+    s[R] = - v * delta / Lf;
+    s[CTE] = cte;
+    s[EPSI] = epsi;
+  }
+};
+
+// x position of the point at arc length `s` along the reference line,
+// measured from x = 0.
+inline double PathXAtArcLength(const Eigen::VectorXd &coeffs, double s)
+{
+  // dx/ds = 1 / sqrt(1 + f'(x)^2), integrated with the midpoint rule.
+  const size_t steps = 1 + (size_t)(fabs(s) / 0.5);
+  const double h = s / steps;
+  double x = 0;
+  for (size_t k=0; k<steps; k++)
+  {
+    double xm = x + 0.5 * h / sqrt(1 + pow(polyslope3(coeffs, x), 2));
+    x += h / sqrt(1 + pow(polyslope3(coeffs, xm), 2));
+  }
+  return x;
+}
+
+// Signed curvature of the reference line at x, positive when it turns left.
+inline double PathSignedCurvature(const Eigen::VectorXd &coeffs, double x)
+{
+  double slope = polyslope3(coeffs, x);
+  return (2 * coeffs[2] + 6 * coeffs[3] * x) / pow(1 + slope * slope, 1.5);
+}
+
+// Reduced model in path coordinates (Frenet frame).
+// State [s, e_y, e_psi, v], actuators [delta, a], where s is the arc length
+// along the reference line, e_y = f(x) - y is the cross track error and
+// e_psi = psi - psides the orientation error. The curvature kappa of the
+// reference line is a stage parameter, evaluated at the nominal arc length
+// of the stage, so neither the polynomial nor atan enter the NLP. The cost
+// curvature, see CostCurvature, is a second parameter at the same point.
+// s'     = v * cos(e_psi) / (1 + kappa * e_y)
+// e_y'   = - v * sin(e_psi)
+// e_psi' = - v * delta / Lf - kappa * s'
+// v'     = a
+// Unlike cte in the kinematic model, e_y is not recomputed from x and y at
+// every step, so its derivative carries the geometric sign.
+struct FrenetModel {
+  static const size_t n_states = 4;
+  static const size_t n_inputs = 2;
+  static const size_t n_params = 2;
+  enum { S, CTE, EPSI, V };
+  enum { DELTA, A };
+  enum { KAPPA, COST_KAPPA };
+
+  static double input_lower(size_t j) { return KinematicModel::input_lower(j); }
+  static double input_upper(size_t j) { return KinematicModel::input_upper(j); }
+
+  // The stage is assumed to be reached at the initial speed.
+  static void stage_params(const double *s0, const Eigen::VectorXd &coeffs,
+                           double time, double *p)
+  {
+    double s = s0[S] + s0[V] * time;
+    double x = PathXAtArcLength(coeffs, s);
+    p[KAPPA] = PathSignedCurvature(coeffs, x);
+    p[COST_KAPPA] = CostCurvature(coeffs, x);
+  }
+
+  template <typename T>
+  static void derivative(const T *s, const T *u, const double *p, T *sdot)
+  {
+    using std::cos;
+    using std::sin;
+    const double kappa = p[KAPPA];
+    sdot[S] = s[V] * cos(s[EPSI]) / (1 + kappa * s[CTE]);
+    sdot[CTE] = - s[V] * sin(s[EPSI]);
+    sdot[EPSI] = - s[V] * u[DELTA] / Lf - kappa * sdot[S];
+    sdot[V] = u[A];
+  }
+
+  template <typename T>
+  static void step(const T *s0, const T *u0, const double *p,
+                   const Eigen::VectorXd &coeffs, double dt,
+                   Integrator method, size_t substeps, T *s1)
+  {
+    ModelDerivative<FrenetModel, T> f = {u0, p};
+    T ds[n_states];
+    IntegrateIncrement<n_states>(method, substeps, f, s0, dt, ds);
+    for (size_t i=0; i<n_states; i++) { s1[i] = s0[i] + ds[i]; }
+  }
+
+  template <typename T>
+  static T curvature(const T *s, const double *p, const Eigen::VectorXd &coeffs)
+  {
+    return p[COST_KAPPA];
+  }
+
+  // The point at arc length s on the reference line, moved by e_y to the
+  // right of the line.
+  static void position(const double *s, const Eigen::VectorXd &coeffs,
+                       double &x, double &y)
+  {
+    double xp = PathXAtArcLength(coeffs, s[S]);
+    double heading = atan(polyslope3(coeffs, xp));
+    x = xp + s[CTE] * sin(heading);
+    y = polyeval3(coeffs, xp) - s[CTE] * cos(heading);
+  }
+
+  static void initial_state(double v, double cte, double epsi, double delta,
+                            double *s)
+  {
+    s[S] = 0;
+    s[CTE] = cte;
+    s[EPSI] = epsi;
+    s[V] = v;
+  }
+};
+
+#endif /* VEHICLE_MODEL_H */
@@ -0,0 +1,242 @@
+#include "wire_format.h"
+#include <math.h>
+#include <cstring>
+
+using json = nlohmann::json;
+
+namespace {
+
+json TelemetryJson(const Telemetry &telemetry, double time)
+{
+  json data;
+  data["ptsx"] = telemetry.ptsx;
+  data["ptsy"] = telemetry.ptsy;
+  data["x"] = telemetry.x;
+  data["y"] = telemetry.y;
+  data["psi"] = telemetry.psi;
+  data["speed"] = telemetry.speed;
+  data["steering_angle"] = telemetry.steering_angle;
+  data["throttle"] = telemetry.throttle;
+  if (!isnan(time)) { data["time"] = time; }
+  return data;
+}
+
+// Parse the data object of a MessagePack or CBOR frame.
+bool ParseBinary(WireFormat format, const char *data, size_t length, json &j, string &error)
+{
+  try
+  {
+    vector<uint8_t> bytes(data, data + length);
+    j = format == WIRE_MSGPACK ? json::from_msgpack(bytes) : json::from_cbor(bytes);
+  }
+  catch (const std::exception &e)
+  {
+    error = e.what();
+    return false;
+  }
+  if (!j.is_object())
+  {
+    error = "not an object";
+    return false;
+  }
+  return true;
+}
+
+void AppendDoubles(vector<char> &out, const vector<double> &values)
+{
+  const char *bytes = reinterpret_cast<const char *>(values.data());
+  out.insert(out.end(), bytes, bytes + values.size() * sizeof(double));
+}
+
+}  // namespace
+
+bool ParseWireFormat(const string &name, WireFormat &format)
+{
+  if (name == "text") { format = WIRE_TEXT; }
+  else if (name == "msgpack") { format = WIRE_MSGPACK; }
+  else if (name == "cbor") { format = WIRE_CBOR; }
+  else if (name == "packed") { format = WIRE_PACKED; }
+  else { return false; }
+  return true;
+}
+
+bool TelemetryFromJson(const json &data, Telemetry &telemetry, double &time, string &error)
+{
+  try
+  {
+    // at() throws on a missing key, where the const operator[] asserts.
+    telemetry.ptsx = data.at("ptsx").get<vector<double> >();
+    telemetry.ptsy = data.at("ptsy").get<vector<double> >();
+    telemetry.x = data.at("x");
+    telemetry.y = data.at("y");
+    telemetry.psi = data.at("psi");
+    telemetry.speed = data.at("speed");
+    telemetry.steering_angle = data.at("steering_angle");
+    telemetry.throttle = data.at("throttle");
+    // A simulator running faster than real time sends its clock.
+    time = data.count("time") > 0 ? data.at("time").get<double>() : NAN;
+  }
+  catch (const std::exception &e)
+  {
+    error = e.what();
+    return false;
+  }
+  // The waypoints are transformed pairwise and fitted with a cubic.
+  if (telemetry.ptsx.size() != telemetry.ptsy.size())
+  {
+    error = "ptsx and ptsy differ in size";
+    return false;
+  }
+  if (telemetry.ptsx.size() < wire_min_points)
+  {
+    error = "too few waypoints";
+    return false;
+  }
+  return true;
+}
+
+bool DecodeTelemetry(WireFormat format, const char *data, size_t length,
+                     Telemetry &telemetry, double &time, string &error)
+{
+  if (format == WIRE_PACKED)
+  {
+    PackedTelemetry header;
+    if (length < sizeof(header))
+    {
+      error = "short packed telemetry";
+      return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    // In size_t, from the length, so that no point count can overflow it.
+    size_t points_size = length - sizeof(header);
+    if (memcmp(header.magic, "MPT1", 4) != 0 || header.n_points > wire_max_points ||
+        points_size % (2 * sizeof(double)) != 0 ||
+        points_size / (2 * sizeof(double)) != header.n_points)
+    {
+      error = "malformed packed telemetry";
+      return false;
+    }
+    // ptsx and ptsy share n_points, so only their number is left to check.
+    if (header.n_points < wire_min_points)
+    {
+      error = "too few waypoints";
+      return false;
+    }
+    const char *points = data + sizeof(header);
+    telemetry.ptsx.resize(header.n_points);
+    telemetry.ptsy.resize(header.n_points);
+    memcpy(telemetry.ptsx.data(), points, header.n_points * sizeof(double));
+    memcpy(telemetry.ptsy.data(), points + header.n_points * sizeof(double),
+           header.n_points * sizeof(double));
+    telemetry.x = header.x;
+    telemetry.y = header.y;
+    telemetry.psi = header.psi;
+    telemetry.speed = header.speed;
+    telemetry.steering_angle = header.steering_angle;
+    telemetry.throttle = header.throttle;
+    time = header.time;
+    return true;
+  }
+  if (format == WIRE_TEXT)
+  {
+    error = "text telemetry in a binary frame";
+    return false;
+  }
+  json j;
+  if (!ParseBinary(format, data, length, j, error)) { return false; }
+  return TelemetryFromJson(j, telemetry, time, error);
+}
+
+void EncodeTelemetry(WireFormat format, const Telemetry &telemetry, double time,
+                     vector<char> &out)
+{
+  out.clear();
+  if (format == WIRE_PACKED)
+  {
+    PackedTelemetry header;
+    memcpy(header.magic, "MPT1", 4);
+    header.n_points = telemetry.ptsx.size();
+    header.x = telemetry.x;
+    header.y = telemetry.y;
+    header.psi = telemetry.psi;
+    header.speed = telemetry.speed;
+    header.steering_angle = telemetry.steering_angle;
+    header.throttle = telemetry.throttle;
+    header.time = time;
+    const char *bytes = reinterpret_cast<const char *>(&header);
+    out.insert(out.end(), bytes, bytes + sizeof(header));
+    AppendDoubles(out, telemetry.ptsx);
+    AppendDoubles(out, telemetry.ptsy);
+    return;
+  }
+  json data = TelemetryJson(telemetry, time);
+  if (format == WIRE_TEXT)
+  {
+    string text = "42[\"telemetry\"," + data.dump() + "]";
+    out.assign(text.begin(), text.end());
+    return;
+  }
+  vector<uint8_t> bytes = format == WIRE_MSGPACK ? json::to_msgpack(data) : json::to_cbor(data);
+  out.assign(bytes.begin(), bytes.end());
+}
+
+bool DecodeSteer(WireFormat format, const char *data, size_t length, double &steering,
+                 double &throttle, string &error)
+{
+  if (format == WIRE_PACKED)
+  {
+    PackedSteer header;
+    if (length < sizeof(header))
+    {
+      error = "short packed steer";
+      return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, "MPS1", 4) != 0)
+    {
+      error = "malformed packed steer";
+      return false;
+    }
+    steering = header.steering_angle;
+    throttle = header.throttle;
+    return true;
+  }
+  json j;
+  if (format == WIRE_TEXT)
+  {
+    string s(data, length);
+    size_t start = s.find('[');
+    if (s.compare(0, 2, "42") != 0 || start == string::npos)
+    {
+      error = "not an event";
+      return false;
+    }
+    try
+    {
+      json event = json::parse(s.substr(start));
+      if (event[0].get<string>() != "steer")
+      {
+        error = "not a steer event";
+        return false;
+      }
+      j = event[1];
+    }
+    catch (const std::exception &e)
+    {
+      error = e.what();
+      return false;
+    }
+  }
+  else if (!ParseBinary(format, data, length, j, error))
+  {
+    return false;
+  }
+  if (!j["steering_angle"].is_number() || !j["throttle"].is_number())
+  {
+    error = "no actuators";
+    return false;
+  }
+  steering = j["steering_angle"];
+  throttle = j["throttle"];
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "controller.h"
+#include "json.hpp"
+
+using namespace std;
+
+// Encodings of the telemetry and the steer replies on the websocket.
+//  - WIRE_TEXT: the socket.io style text frames of the simulator,
+//    42["telemetry",{...}] and 42["steer",{...}].
+//  - WIRE_MSGPACK, WIRE_CBOR: binary frames holding the data object of the
+//    text frame, {"ptsx":[..],..} or {"steering_angle":..,..}, in
+//    MessagePack or CBOR.
+//  - WIRE_PACKED: binary frames of fixed layout, PackedTelemetry or
+//    PackedSteer followed by the arrays of doubles, in the byte order of
+//    the host.
+// A client picks a binary format with the query of its URL, e.g.
+// ws://localhost:4567/?format=packed, then sends binary frames.
+enum WireFormat {
+  WIRE_TEXT,
+  WIRE_MSGPACK,
+  WIRE_CBOR,
+  WIRE_PACKED
+};
+
+bool ParseWireFormat(const string &name, WireFormat &format);
+
+// Largest number of waypoints of a packed telemetry frame.
+const size_t wire_max_points = 1024;
+// Fewest waypoints of a telemetry frame, as many as the coefficients of the
+// cubic fitted to them.
+const size_t wire_min_points = 4;
+
+// Header of a packed telemetry frame, followed by ptsx and ptsy.
+struct PackedTelemetry {
+  // "MPT1"
+  char magic[4];
+  uint32_t n_points;
+  double x;
+  double y;
+  double psi;
+  double speed;
+  double steering_angle;
+  double throttle;
+  // Simulated time in seconds, NaN if the sender has no clock.
+  double time;
+};
+
+// Header of a packed steer frame, followed by mpc_x and mpc_y of n_plan
+// values each, then next_x and next_y of n_next values each.
+struct PackedSteer {
+  // "MPS1"
+  char magic[4];
+  uint32_t n_plan;
+  uint32_t n_next;
+  uint32_t reserved;
+  double steering_angle;
+  double throttle;
+};
+
+// The telemetry in the data object of a text or MessagePack/CBOR frame.
+// `time` is NaN when the object has no "time". Returns false with `error`
+// set if a field is missing or of the wrong type, or if ptsx and ptsy
+// differ in size or have fewer than wire_min_points.
+bool TelemetryFromJson(const nlohmann::json &data, Telemetry &telemetry, double &time,
+                       string &error);
+
+// Decode a binary telemetry frame. Returns false with `error` set if the
+// frame is malformed.
+bool DecodeTelemetry(WireFormat format, const char *data, size_t length,
+                     Telemetry &telemetry, double &time, string &error);
+
+// Encode a telemetry frame, for clients such as mpc_sim. `time` is left out
+// if NaN. The text format gives the whole 42["telemetry",...] message.
+void EncodeTelemetry(WireFormat format, const Telemetry &telemetry, double time,
+                     vector<char> &out);
+
+// Decode the actuators of a steer reply in any format.
+bool DecodeSteer(WireFormat format, const char *data, size_t length, double &steering,
+                 double &throttle, string &error);
+
+#endif /* WIRE_FORMAT_H */
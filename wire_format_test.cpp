@@ -0,0 +1,160 @@
+// Checks that the telemetry decoders of wire_format.h read back what the
+// encoders wrote, and reject the malformed frames the control loop must
+// never get: a missing field, a packed point count that overflows 32 bits
+// when doubled, ptsx and ptsy of different sizes, and fewer waypoints than
+// the cubic fitted to them has coefficients.
+//
+// Build it next to the controller, e.g.
+//   g++ -std=c++11 wire_format_test.cpp wire_format.cpp -o wire_format_test
+// It prints every failed check and exits with 1 if there was one.
+#include <math.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "wire_format.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const char *what, WireFormat format)
+{
+  if (ok) { return; }
+  printf("FAILED: %s, format %d\n", what, format);
+  failures++;
+}
+
+// First telemetry message of the simulator on the lake track.
+Telemetry LakeTelemetry()
+{
+  Telemetry t;
+  t.ptsx = {-32.16173, -43.49173, -61.09, -78.29172, -93.05002, -107.7717};
+  t.ptsy = {113.361, 105.941, 92.88499, 78.73102, 65.34102, 50.57938};
+  t.x = -40.62;
+  t.y = 108.73;
+  t.psi = 3.733651;
+  t.speed = 40;
+  t.steering_angle = 0.05;
+  t.throttle = 0.3;
+  return t;
+}
+
+// `telemetry` in a MessagePack or CBOR frame after `edit` changed its
+// object, as a sender could.
+template <class Edit>
+vector<char> EditedFrame(WireFormat format, const Telemetry &telemetry, Edit edit)
+{
+  vector<char> data;
+  EncodeTelemetry(format, telemetry, NAN, data);
+  vector<uint8_t> bytes(data.begin(), data.end());
+  json j = format == WIRE_MSGPACK ? json::from_msgpack(bytes) : json::from_cbor(bytes);
+  edit(j);
+  bytes = format == WIRE_MSGPACK ? json::to_msgpack(j) : json::to_cbor(j);
+  return vector<char>(bytes.begin(), bytes.end());
+}
+
+bool Decodes(WireFormat format, const vector<char> &data)
+{
+  Telemetry telemetry;
+  double time;
+  string error;
+  return DecodeTelemetry(format, data.data(), data.size(), telemetry, time, error);
+}
+
+void CheckRoundTrip(WireFormat format)
+{
+  Telemetry sent = LakeTelemetry();
+  vector<char> data;
+  EncodeTelemetry(format, sent, 12.5, data);
+  Telemetry received;
+  double time;
+  string error;
+  bool ok = DecodeTelemetry(format, data.data(), data.size(), received, time, error);
+  Check(ok && received.ptsx == sent.ptsx && received.ptsy == sent.ptsy &&
+        received.x == sent.x && received.y == sent.y && received.psi == sent.psi &&
+        received.speed == sent.speed && received.steering_angle == sent.steering_angle &&
+        received.throttle == sent.throttle && time == 12.5,
+        "round trip", format);
+}
+
+void CheckMalformed(WireFormat format)
+{
+  Telemetry t = LakeTelemetry();
+  Telemetry few = t;
+  few.ptsx.resize(wire_min_points - 1);
+  few.ptsy.resize(wire_min_points - 1);
+  vector<char> data;
+  EncodeTelemetry(format, few, NAN, data);
+  Check(!Decodes(format, data), "too few waypoints accepted", format);
+  few.ptsx.resize(wire_min_points, 1.0);
+  few.ptsy.resize(wire_min_points, 1.0);
+  EncodeTelemetry(format, few, NAN, data);
+  Check(Decodes(format, data), "wire_min_points waypoints rejected", format);
+  if (format == WIRE_PACKED)
+  {
+    // With the points of a single waypoint.
+    EncodeTelemetry(format, t, NAN, data);
+    PackedTelemetry header;
+    memcpy(&header, data.data(), sizeof(header));
+    header.n_points = (1u << 31) + 1;
+    vector<char> overflow(sizeof(header) + 2 * sizeof(double), 0);
+    memcpy(overflow.data(), &header, sizeof(header));
+    Check(!Decodes(format, overflow), "overflowing point count accepted", format);
+    // ptsx and ptsy share the count, a frame whose length does not match it
+    // is the packed form of arrays of different sizes.
+    EncodeTelemetry(format, t, NAN, data);
+    data.resize(data.size() - sizeof(double));
+    Check(!Decodes(format, data), "frame shorter than its points accepted", format);
+    return;
+  }
+  Check(!Decodes(format, EditedFrame(format, t, [](json &j) { j.erase("x"); })),
+        "missing x accepted", format);
+  Check(!Decodes(format, EditedFrame(format, t, [](json &j) { j["ptsy"].erase(0); })),
+        "ptsy shorter than ptsx accepted", format);
+  Check(!Decodes(format, EditedFrame(format, t, [](json &j) { j["ptsx"].push_back(0.0); })),
+        "ptsx longer than ptsy accepted", format);
+  Check(!Decodes(format, EditedFrame(format, t, [](json &j) { j["speed"] = "fast"; })),
+        "speed of the wrong type accepted", format);
+}
+
+// The object of a text frame, as the websocket handler reads it.
+void CheckText()
+{
+  vector<char> data;
+  EncodeTelemetry(WIRE_TEXT, LakeTelemetry(), NAN, data);
+  json j = json::parse(string(data.begin() + 2, data.end()))[1];
+  Telemetry telemetry;
+  double time;
+  string error;
+  Check(TelemetryFromJson(j, telemetry, time, error) && isnan(time), "text telemetry",
+        WIRE_TEXT);
+  json mismatched = j;
+  mismatched["ptsx"].push_back(0.0);
+  Check(!TelemetryFromJson(mismatched, telemetry, time, error),
+        "text ptsx longer than ptsy accepted", WIRE_TEXT);
+  json few = j;
+  few["ptsx"] = json::array({1.0, 2.0, 3.0});
+  few["ptsy"] = json::array({1.0, 2.0, 3.0});
+  Check(!TelemetryFromJson(few, telemetry, time, error), "text with 3 waypoints accepted",
+        WIRE_TEXT);
+}
+
+}  // namespace
+
+int main()
+{
+  WireFormat formats[] = {WIRE_MSGPACK, WIRE_CBOR, WIRE_PACKED};
+  for (WireFormat format : formats)
+  {
+    CheckRoundTrip(format);
+    CheckMalformed(format);
+  }
+  CheckText();
+  if (failures > 0) { return 1; }
+  printf("all checks passed\n");
+  return 0;
+}